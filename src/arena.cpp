@@ -0,0 +1,57 @@
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <new>
+#include <sys/mman.h>
+#include "arena.hpp"
+
+/*
+ * The mapping is anonymous, so it starts zeroed and a page costs nothing
+ * until it is first written; the thread that does so gets it on its own
+ * NUMA node. The base sits on a 2 MB boundary and the kernel is asked to
+ * back it with huge pages, which keeps the TLB small for the position
+ * and neighbor arrays that every step sweeps.
+ */
+#define ARENA_LINE 64
+#define ARENA_PAGE (size_t(2) << 20)
+
+Arena::~Arena() {
+	if (map) {
+		munmap(map, sizeMap);
+	}
+}
+
+// room for bytes, or std::bad_alloc as from new
+void arenaReserve(Arena &a, size_t bytes) {
+	a.size = (bytes + ARENA_LINE - 1) / ARENA_LINE * ARENA_LINE;
+	a.used = 0;
+	// one huge page more than needed, to align the base
+	a.sizeMap = (a.size + 2 * ARENA_PAGE - 1) / ARENA_PAGE * ARENA_PAGE;
+	void *p = mmap(nullptr, a.sizeMap, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		a.map = a.base = nullptr;
+		throw std::bad_alloc();
+	}
+	a.map = static_cast<char *>(p);
+	a.base = a.map + (-reinterpret_cast<uintptr_t>(a.map) & (ARENA_PAGE - 1));
+#ifdef MADV_HUGEPAGE
+	madvise(a.base, a.sizeMap - ARENA_PAGE, MADV_HUGEPAGE);
+#endif
+}
+
+void arenaSwap(Arena &a, Arena &b) {
+	std::swap(a.base, b.base);
+	std::swap(a.map, b.map);
+	std::swap(a.size, b.size);
+	std::swap(a.used, b.used);
+	std::swap(a.sizeMap, b.sizeMap);
+}
+
+// the next bytes, rounded up to whole cache lines; the caller reserved
+// what the same sequence of calls added up to on an empty arena
+void *arenaTake(Arena &a, size_t bytes) {
+	size_t at = a.used;
+	a.used += (bytes + ARENA_LINE - 1) / ARENA_LINE * ARENA_LINE;
+	return a.base ? a.base + at : nullptr;
+}
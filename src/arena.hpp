@@ -0,0 +1,24 @@
+/*
+ * One mapping holding the buffers of a run, each on a cache line
+ * boundary, released when the arena goes. An arena with nothing reserved
+ * only adds up what is taken from it (and hands out nullptr), so the same
+ * code can size the mapping first and carve it up after.
+ */
+struct Arena {
+	char *base = nullptr, *map = nullptr;
+	size_t size = 0, used = 0, sizeMap = 0;
+
+	Arena() {}
+	Arena(const Arena &) = delete;
+	Arena &operator=(const Arena &) = delete;
+	~Arena();
+};
+
+void arenaReserve(Arena &, size_t);
+void arenaSwap(Arena &, Arena &);
+void *arenaTake(Arena &, size_t);
+
+template <typename T>
+T *arenaAlloc(Arena &a, long n) {
+	return static_cast<T *>(arenaTake(a, n * sizeof(T)));
+}
@@ -0,0 +1,88 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdlib>
+#include <algorithm>
+#include "types.hpp"
+#include "async_out.hpp"
+
+/*
+ * Output ring: the integrator copies what it wants written into the next
+ * free frame and publishes it; a writer thread formats published frames
+ * in order. When every frame is queued asyncOutAcquire() waits, so memory
+ * stays at nSlot frames however far the disk falls behind. With nSlot = 0
+ * there is no thread and frames are written as soon as they are published.
+ */
+static void writerLoop(AsyncOut &out) {
+	for (;;) {
+		std::unique_lock<std::mutex> lock(out.ringLock);
+		out.ringEmpty.wait(lock, [&] { return out.count > 0 || out.stopOut; });
+		if (out.count == 0) {
+			return;
+		}
+		OutFrame &f = out.ring[out.tail];
+		lock.unlock();
+
+		out.writeFrame(f);
+
+		lock.lock();
+		out.tail = (out.tail + 1) % out.nSlot;
+		out.count--;
+		out.ringFull.notify_one();
+	}
+}
+
+// capacity is the number of doubles a frame must hold
+void asyncOutStart(AsyncOut &out, int slots, int capacity,
+		std::function<void(OutFrame &)> write) {
+	out.nSlot = slots;
+	out.writeFrame = write;
+	out.head = out.tail = out.count = out.stopOut = 0;
+	out.ring.resize(std::max(out.nSlot, 1));
+	for (OutFrame &f : out.ring) {
+		f.data = new double[capacity];
+	}
+	if (out.nSlot > 0) {
+		out.writer = std::thread(writerLoop, std::ref(out));
+	}
+}
+
+OutFrame *asyncOutAcquire(AsyncOut &out) {
+	if (out.nSlot == 0) {
+		return &out.ring[0];
+	}
+	std::unique_lock<std::mutex> lock(out.ringLock);
+	out.ringFull.wait(lock, [&] { return out.count < out.nSlot; });
+	return &out.ring[out.head];
+}
+
+void asyncOutPublish(AsyncOut &out) {
+	if (out.nSlot == 0) {
+		out.writeFrame(out.ring[0]);
+		return;
+	}
+	std::lock_guard<std::mutex> lock(out.ringLock);
+	out.head = (out.head + 1) % out.nSlot;
+	out.count++;
+	out.ringEmpty.notify_one();
+}
+
+// writes everything still queued, then joins the writer
+void asyncOutStop(AsyncOut &out) {
+	if (out.nSlot > 0) {
+		{
+			std::lock_guard<std::mutex> lock(out.ringLock);
+			out.stopOut = 1;
+			out.ringEmpty.notify_one();
+		}
+		out.writer.join();
+	}
+	for (OutFrame &f : out.ring) {
+		delete[] f.data;
+	}
+	out.ring.clear();
+}
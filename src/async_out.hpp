@@ -0,0 +1,19 @@
+#define OUT_DUMP 0
+#define OUT_SUMMARY 1
+#define OUT_TABLE 2
+#define OUT_FLUSH 3
+
+// output ring of one run and the thread writing it out
+struct AsyncOut {
+	std::vector<OutFrame> ring;
+	int nSlot, head, tail, count, stopOut;
+	std::function<void(OutFrame &)> writeFrame;
+	std::mutex ringLock;
+	std::condition_variable ringFull, ringEmpty;
+	std::thread writer;
+};
+
+void asyncOutStart(AsyncOut &, int, int, std::function<void(OutFrame &)>);
+OutFrame *asyncOutAcquire(AsyncOut &);
+void asyncOutPublish(AsyncOut &);
+void asyncOutStop(AsyncOut &);
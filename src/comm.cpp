@@ -0,0 +1,83 @@
+#include <vector>
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+#include "comm.hpp"
+
+/*
+ * Thin layer over MPI so the rest of the code never includes mpi.h:
+ * build with mpicxx -DUSE_MPI and start with mpirun -np N. Messages are
+ * vectors of doubles whose length travels ahead of them, so a receiver
+ * need not know how many atoms are coming. Everything is blocking and
+ * called from the main thread only.
+ */
+#ifdef USE_MPI
+
+void commInit(int *argc, char ***argv) {
+	MPI_Init(argc, argv);
+}
+
+void commFinalize() {
+	MPI_Finalize();
+}
+
+int commRank() {
+	int rank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	return rank;
+}
+
+int commSize() {
+	int size;
+	MPI_Comm_size(MPI_COMM_WORLD, &size);
+	return size;
+}
+
+void commAllreduce(double *v, int n, int op) {
+	MPI_Allreduce(MPI_IN_PLACE, v, n, MPI_DOUBLE, (op == COMM_MAX) ? MPI_MAX : MPI_SUM,
+		MPI_COMM_WORLD);
+}
+
+// sends out to rank to while receiving in from rank from
+void commExchange(int to, std::vector<double> &out, int from, std::vector<double> &in) {
+	if (to == commRank() && from == to) {
+		in = out;
+		return;
+	}
+	long nOut = out.size(), nIn;
+	MPI_Sendrecv(&nOut, 1, MPI_LONG, to, 0, &nIn, 1, MPI_LONG, from, 0,
+		MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+	in.resize(nIn);
+	MPI_Sendrecv(out.data(), nOut, MPI_DOUBLE, to, 1, in.data(), nIn, MPI_DOUBLE, from, 1,
+		MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+}
+
+void commSend(int to, std::vector<double> &out) {
+	long nOut = out.size();
+	MPI_Send(&nOut, 1, MPI_LONG, to, 0, MPI_COMM_WORLD);
+	MPI_Send(out.data(), nOut, MPI_DOUBLE, to, 1, MPI_COMM_WORLD);
+}
+
+void commRecv(int from, std::vector<double> &in) {
+	long nIn;
+	MPI_Recv(&nIn, 1, MPI_LONG, from, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+	in.resize(nIn);
+	MPI_Recv(in.data(), nIn, MPI_DOUBLE, from, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+}
+
+#else
+
+void commInit(int *, char ***) {}
+void commFinalize() {}
+int commRank() { return 0; }
+int commSize() { return 1; }
+void commAllreduce(double *, int, int) {}
+
+void commExchange(int, std::vector<double> &out, int, std::vector<double> &in) {
+	in = out;
+}
+
+void commSend(int, std::vector<double> &) {}
+void commRecv(int, std::vector<double> &) {}
+
+#endif
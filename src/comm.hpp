@@ -0,0 +1,13 @@
+// messages between the ranks of a domain decomposed run; built without
+// USE_MPI there is a single rank and none of these is ever needed
+#define COMM_SUM 0
+#define COMM_MAX 1
+
+void commInit(int *, char ***);
+void commFinalize();
+int commRank();
+int commSize();
+void commAllreduce(double *, int, int);
+void commExchange(int, std::vector<double> &, int, std::vector<double> &);
+void commSend(int, std::vector<double> &);
+void commRecv(int, std::vector<double> &);
@@ -0,0 +1,55 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <sstream>
+#include <map>
+#include "config.hpp"
+
+/*
+ * Input file: one "key = value" per line, '#' starts a comment. For old
+ * input files, up to five bare values before the first key are taken as
+ * temperature, density, number of atoms, mass ratio and time step.
+ */
+static const char *legacyKeys[] = {"temperature", "density", "num_atoms",
+	"mass_ratio", "delta_t"};
+
+static std::string trim(std::string s) {
+	size_t lo = s.find_first_not_of(" \t\r"), hi = s.find_last_not_of(" \t\r");
+	return (lo == std::string::npos) ? "" : s.substr(lo, hi - lo + 1);
+}
+
+int readConfig(std::string name, std::map<std::string, std::string> &cfg) {
+	std::ifstream in(name);
+	if (!in) {
+		std::cerr << name << ": cannot open\n";
+		return 0;
+	}
+
+	std::string line;
+	int nLine = 0, nLegacy = 0, keyed = 0;
+	while (std::getline(in, line)) {
+		nLine++;
+		line = line.substr(0, line.find('#'));
+		size_t eq = line.find('=');
+		std::string key = trim(line.substr(0, eq));
+		if (eq == std::string::npos) {
+			if (key.empty()) {
+				continue;
+			}
+			if (keyed || nLegacy == 5) {
+				std::cerr << name << ':' << nLine << ": expected key = value\n";
+				return 0;
+			}
+			cfg[legacyKeys[nLegacy++]] = key;
+			continue;
+		}
+		std::string val = trim(line.substr(eq + 1));
+		if (key.empty() || val.empty()) {
+			std::cerr << name << ':' << nLine << ": expected key = value\n";
+			return 0;
+		}
+		cfg[key] = val;
+		keyed = 1;
+	}
+	return 1;
+}
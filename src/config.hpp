@@ -0,0 +1,17 @@
+int readConfig(std::string, std::map<std::string, std::string> &);
+
+// sets val from key and drops the key; a value that does not parse is left
+// in cfg, where the caller reports it with the unknown keys
+template <typename T>
+void cfgGet(std::map<std::string, std::string> &cfg, std::string key, T &val) {
+	auto it = cfg.find(key);
+	if (it == cfg.end()) {
+		return;
+	}
+	std::istringstream in(it->second);
+	T v;
+	if (in >> v && (in >> std::ws).eof()) {
+		val = v;
+		cfg.erase(it);
+	}
+}
@@ -0,0 +1,88 @@
+#include <cmath>
+#include <complex>
+#include <vector>
+#include "correl.hpp"
+
+/*
+ * in-place radix-2 FFT, a.size() a power of two; the inverse transform
+ * (inverse = 1) is not divided by the length
+ */
+void fft(std::vector<std::complex<double>> &a, int inverse) {
+	int n = a.size();
+	for (int i = 1, j = 0; i < n; i++) {
+		int bit = n >> 1;
+		for (; j & bit; bit >>= 1) {
+			j ^= bit;
+		}
+		j ^= bit;
+		if (i < j) {
+			std::swap(a[i], a[j]);
+		}
+	}
+	for (int len = 2; len <= n; len <<= 1) {
+		double ang = 2 * M_PI / len * (inverse ? 1 : -1);
+		std::complex<double> wLen(std::cos(ang), std::sin(ang));
+		for (int i = 0; i < n; i += len) {
+			std::complex<double> w(1);
+			for (int k = 0; k < len / 2; k++) {
+				std::complex<double> u = a[i+k], v = a[i+k+len/2] * w;
+				a[i+k] = u + v;
+				a[i+k+len/2] = u - v;
+				w *= wLen;
+			}
+		}
+	}
+}
+
+/*
+ * adds the autocorrelation of x[0..n-1] averaged over all time origins,
+ * sum_t x(t) x(t+m) / (n-m), to acf[m] for m < nLag; the series is zero
+ * padded to twice its length so the circular correlation does not wrap;
+ * nLag must not exceed n
+ */
+void accumAutoCorr(const double *x, int n, int nLag, double *acf) {
+	int nFft = 1;
+	while (nFft < 2 * n) {
+		nFft <<= 1;
+	}
+	static thread_local std::vector<std::complex<double>> a;
+	a.assign(nFft, 0);
+	for (int t = 0; t < n; t++) {
+		a[t] = x[t];
+	}
+	fft(a, 0);
+	for (int k = 0; k < nFft; k++) {
+		a[k] = std::norm(a[k]);
+	}
+	fft(a, 1);
+	for (int m = 0; m < nLag; m++) {
+		acf[m] += a[m].real() / nFft / (n - m);
+	}
+}
+
+/*
+ * adds the mean square displacement of x[0..n-1] over all time origins,
+ * sum_t (x(t+m) - x(t))^2 / (n-m), to msd[m] for m < nLag: the squares
+ * come from a running sum, the cross term from the autocorrelation;
+ * nLag must not exceed n
+ */
+void accumMsd(const double *x, int n, int nLag, double *msd) {
+	// shifted to start at zero, which keeps the cancellation small
+	static thread_local std::vector<double> y, s2;
+	y.resize(n);
+	for (int t = 0; t < n; t++) {
+		y[t] = x[t] - x[0];
+	}
+	s2.assign(nLag, 0);
+	accumAutoCorr(y.data(), n, nLag, s2.data());
+
+	double q = 0;
+	for (int t = 0; t < n; t++) {
+		q += 2 * y[t] * y[t];
+	}
+	// msd[0] is zero by definition
+	for (int m = 1; m < nLag; m++) {
+		q -= y[m-1] * y[m-1] + y[n-m] * y[n-m];
+		msd[m] += q / (n - m) - 2 * s2[m];
+	}
+}
@@ -0,0 +1,3 @@
+void fft(std::vector<std::complex<double>> &, int);
+void accumAutoCorr(const double *, int, int, double *);
+void accumMsd(const double *, int, int, double *);
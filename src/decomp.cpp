@@ -0,0 +1,477 @@
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <fstream>
+#include <map>
+#include <vector>
+#include <cstdlib>
+
+#include "types.hpp"
+#include "vec_cal.hpp"
+#include "comm.hpp"
+#include "perf.hpp"
+#include "arena.hpp"
+#include "md.hpp"
+
+/*
+ * Domain decomposition over the ranks of an MPI run. The region is cut
+ * into procGrid sub-boxes, one per rank, numbered with x fastest. A rank
+ * keeps the nLocal atoms of its sub-box in mol[0..nLocal), followed by
+ * nGhost copies of the atoms within rHalo of it, shifted across the
+ * periodic boundary where needed so that every pair is a plain difference.
+ * Ghosts are gathered in six stages, the low and high faces of x, then y,
+ * then z; later stages pass on the ghosts of earlier ones, which covers
+ * edges and corners. At each neighbor list rebuild the atoms that left
+ * their sub-box move to the neighbor rank and the stages are set up
+ * again; in between only ghost positions travel, along the same lists,
+ * and ghost accelerations travel back after the forces. Positions are
+ * only wrapped into the box at rebuilds, so in between no atom is more
+ * than half the skin outside it and no ghost jumps by a box length.
+ */
+
+// sub-box of position r along a side of length len cut into p
+static int ddCoord(double r, double len, int p) {
+	int c = int((r + 0.5 * len) / len * p);
+	return std::min(std::max(c, 0), p - 1);
+}
+
+static void copyAtom(Mol &m, int j, int i) {
+	m.rx[j] = m.rx[i];
+	m.ry[j] = m.ry[i];
+	m.rz[j] = m.rz[i];
+	m.vx[j] = m.vx[i];
+	m.vy[j] = m.vy[i];
+	m.vz[j] = m.vz[i];
+	m.ax[j] = m.ax[i];
+	m.ay[j] = m.ay[i];
+	m.az[j] = m.az[i];
+	m.mass[j] = m.mass[i];
+	m.type[j] = m.type[i];
+	m.id[j] = m.id[i];
+	m.imx[j] = m.imx[i];
+	m.imy[j] = m.imy[i];
+	m.imz[j] = m.imz[i];
+}
+
+/*
+ * Every rank has set up the whole system; this picks the grid of
+ * sub-boxes with the least surface and keeps the atoms of this rank.
+ * 0 if the box cannot be cut into sub-boxes as wide as the halo.
+ */
+int Sim::ddInit() {
+	nLocal = nMol;
+	nGhost = 0;
+	nRank = commSize();
+	rank = commRank();
+	if (nRank == 1) {
+		return 1;
+	}
+
+	// ghosts reach far enough for the forces and the RDF until the next
+	// rebuild, however the atoms move within the skin
+	rHalo = std::max(rCut, rangeRdf) + rNebrShell;
+	double len[] = {region.x, region.y, region.z}, best = 0;
+	for (int px = 1; px <= nRank; px++) {
+		for (int py = 1; px * py <= nRank; py++) {
+			int p[] = {px, py, nRank / (px * py)};
+			if (p[0] * p[1] * p[2] != nRank) {
+				continue;
+			}
+			int fits = 1;
+			double area = 0;
+			for (int d = 0; d < 3; d++) {
+				fits &= len[d] / p[d] >= rHalo && len[d] >= 2 * rHalo;
+				area += len[(d+1)%3] / p[(d+1)%3] * len[(d+2)%3] / p[(d+2)%3];
+			}
+			if (fits && (best == 0 || area < best)) {
+				best = area;
+				std::copy(p, p + 3, procGrid);
+			}
+		}
+	}
+	if (best == 0) {
+		return 0;
+	}
+
+	procPos[0] = rank % procGrid[0];
+	procPos[1] = (rank / procGrid[0]) % procGrid[1];
+	procPos[2] = rank / (procGrid[0] * procGrid[1]);
+	for (int d = 0; d < 3; d++) {
+		int q[] = {procPos[0], procPos[1], procPos[2]};
+		q[d] = (procPos[d] + procGrid[d] - 1) % procGrid[d];
+		procLo[d] = q[0] + procGrid[0] * (q[1] + procGrid[1] * q[2]);
+		q[d] = (procPos[d] + 1) % procGrid[d];
+		procHi[d] = q[0] + procGrid[0] * (q[1] + procGrid[1] * q[2]);
+		subLo[d] = -0.5 * len[d] + procPos[d] * len[d] / procGrid[d];
+		subHi[d] = subLo[d] + len[d] / procGrid[d];
+	}
+	ddRecLen = 15 + 6 * nBuffDiff + 3 * nBuffAcf;
+
+	double *r[] = {mol.rx, mol.ry, mol.rz};
+	nLocal = 0;
+	for (int i = 0; i < nMol; i++) {
+		int mine = 1;
+		for (int d = 0; d < 3; d++) {
+			mine &= ddCoord(r[d][i], len[d], procGrid[d]) == procPos[d];
+		}
+		if (mine) {
+			copyAtom(mol, nLocal++, i);
+		}
+	}
+	return 1;
+}
+
+// room for n local and ghost atoms in everything indexed by slot; the
+// slot buffers move to an arena of their own, and the one before goes
+void Sim::ddGrow(int n) {
+	if (n <= nMolMax) {
+		return;
+	}
+	Mol m = mol;
+	nMolMax = n + n / 4;
+	nMolPad = ((nMolMax + 7) / 8) * 8;
+	Arena sizing, a;
+	allocSlots(sizing);
+	arenaReserve(a, sizing.used);
+	allocSlots(a);
+
+	// only the atoms carry over; forces and neighbor list are rebuilt
+	// before they are next read
+	int nAll = nLocal + nGhost;
+	double *from[] = {m.rx, m.ry, m.rz, m.vx, m.vy, m.vz, m.ax, m.ay, m.az, m.mass};
+	double *to[] = {mol.rx, mol.ry, mol.rz, mol.vx, mol.vy, mol.vz,
+		mol.ax, mol.ay, mol.az, mol.mass};
+	for (int k = 0; k < 10; k++) {
+		std::copy(from[k], from[k] + nAll, to[k]);
+	}
+	int *fromI[] = {m.type, m.id, m.imx, m.imy, m.imz};
+	int *toI[] = {mol.type, mol.id, mol.imx, mol.imy, mol.imz};
+	for (int k = 0; k < 5; k++) {
+		std::copy(fromI[k], fromI[k] + nAll, toI[k]);
+	}
+	arenaSwap(arenaSlot, a);
+}
+
+// an atom leaving the rank takes its MSD and VACF origins along
+void Sim::ddPackAtom(std::vector<double> &buf, int i) {
+	double rec[] = {mol.rx[i], mol.ry[i], mol.rz[i], mol.vx[i], mol.vy[i], mol.vz[i],
+		mol.ax[i], mol.ay[i], mol.az[i], mol.mass[i], double(mol.type[i]),
+		double(mol.id[i]), double(mol.imx[i]), double(mol.imy[i]), double(mol.imz[i])};
+	buf.insert(buf.end(), rec, rec + 15);
+	int id = mol.id[i], k = typeIdx[id];
+	for (int nb = 0; nb < nBuffDiff; nb++) {
+		Tbuff &b = (mol.type[i] == 1) ? bufferAA[nb] : bufferBB[nb];
+		double org[] = {b.orgR[k].x, b.orgR[k].y, b.orgR[k].z,
+			double(b.orgIm[k].x), double(b.orgIm[k].y), double(b.orgIm[k].z)};
+		buf.insert(buf.end(), org, org + 6);
+	}
+	for (int nb = 0; nb < nBuffAcf; nb++) {
+		vecR &v = vacBuff[nb].orgVel[id];
+		buf.insert(buf.end(), {v.x, v.y, v.z});
+	}
+}
+
+void Sim::ddUnpackAtom(const double *p, int i) {
+	mol.rx[i] = p[0];
+	mol.ry[i] = p[1];
+	mol.rz[i] = p[2];
+	mol.vx[i] = p[3];
+	mol.vy[i] = p[4];
+	mol.vz[i] = p[5];
+	mol.ax[i] = p[6];
+	mol.ay[i] = p[7];
+	mol.az[i] = p[8];
+	mol.mass[i] = p[9];
+	mol.type[i] = int(p[10]);
+	mol.id[i] = int(p[11]);
+	mol.imx[i] = int(p[12]);
+	mol.imy[i] = int(p[13]);
+	mol.imz[i] = int(p[14]);
+	p += 15;
+	int id = mol.id[i], k = typeIdx[id];
+	for (int nb = 0; nb < nBuffDiff; nb++, p += 6) {
+		Tbuff &b = (mol.type[i] == 1) ? bufferAA[nb] : bufferBB[nb];
+		vecSet(b.orgR[k], p[0], p[1], p[2]);
+		b.orgIm[k] = {int(p[3]), int(p[4]), int(p[5])};
+	}
+	for (int nb = 0; nb < nBuffAcf; nb++, p += 3) {
+		vecSet(vacBuff[nb].orgVel[id], p[0], p[1], p[2]);
+	}
+}
+
+/*
+ * Between rebuilds no atom moves more than half the skin, so one that
+ * left its sub-box is in the next one over; dimensions are done in turn,
+ * and an atom that crossed a corner moves on in the next.
+ */
+void Sim::ddMigrate() {
+	double len[] = {region.x, region.y, region.z};
+	nGhost = 0;
+	for (int d = 0; d < 3; d++) {
+		if (procGrid[d] == 1) {
+			continue;
+		}
+		double *r = (d == 0) ? mol.rx : (d == 1) ? mol.ry : mol.rz;
+		ddOut.clear();
+		ddOut2.clear();
+		for (int i = nLocal - 1; i >= 0; i--) {
+			int c = ddCoord(r[i], len[d], procGrid[d]);
+			if (c != procPos[d]) {
+				int down = c == (procPos[d] + procGrid[d] - 1) % procGrid[d];
+				ddPackAtom(down ? ddOut : ddOut2, i);
+				copyAtom(mol, i, --nLocal);
+			}
+		}
+		commExchange(procLo[d], ddOut, procHi[d], ddIn);
+		commExchange(procHi[d], ddOut2, procLo[d], ddIn2);
+		ddGrow(nLocal + int(ddIn.size() + ddIn2.size()) / ddRecLen);
+		for (std::vector<double> *in : {&ddIn, &ddIn2}) {
+			for (size_t p = 0; p < in->size(); p += ddRecLen) {
+				ddUnpackAtom(in->data() + p, nLocal++);
+			}
+		}
+	}
+}
+
+// finds the ghosts of each stage and records who sends what
+void Sim::ddHaloBuild() {
+	double len[] = {region.x, region.y, region.z};
+	nGhost = 0;
+	for (int d = 0; d < 3; d++) {
+		int nAll = nLocal + nGhost;
+		for (int k = 0; k < 2; k++) {
+			int s = 2 * d + k;
+			const double *r = (d == 0) ? mol.rx : (d == 1) ? mol.ry : mol.rz;
+			haloSend[s].clear();
+			for (int i = 0; i < nAll; i++) {
+				if (k == 0 ? r[i] < subLo[d] + rHalo : r[i] >= subHi[d] - rHalo) {
+					haloSend[s].push_back(i);
+				}
+			}
+			// what leaves through the edge of the box comes in on the far side
+			haloShift[s] = 0;
+			if (k == 0 && procPos[d] == 0) {
+				haloShift[s] = len[d];
+			}
+			if (k == 1 && procPos[d] == procGrid[d] - 1) {
+				haloShift[s] = -len[d];
+			}
+
+			ddOut.clear();
+			for (int i : haloSend[s]) {
+				double rec[] = {mol.rx[i], mol.ry[i], mol.rz[i], double(mol.type[i]),
+					double(mol.id[i]), mol.mass[i]};
+				rec[d] += haloShift[s];
+				ddOut.insert(ddOut.end(), rec, rec + 6);
+			}
+			commExchange((k == 0) ? procLo[d] : procHi[d], ddOut,
+				(k == 0) ? procHi[d] : procLo[d], ddIn);
+			int n = ddIn.size() / 6;
+			ddGrow(nLocal + nGhost + n);
+			haloFirst[s] = nLocal + nGhost;
+			haloCount[s] = n;
+			for (int g = 0; g < n; g++) {
+				const double *p = ddIn.data() + 6 * g;
+				int i = haloFirst[s] + g;
+				mol.rx[i] = p[0];
+				mol.ry[i] = p[1];
+				mol.rz[i] = p[2];
+				mol.type[i] = int(p[3]);
+				mol.id[i] = int(p[4]);
+				mol.mass[i] = p[5];
+			}
+			nGhost += n;
+		}
+	}
+}
+
+// new ghost positions along the lists of the last build
+void Sim::ddHaloUpdate() {
+	for (int s = 0; s < 6; s++) {
+		int d = s / 2, k = s % 2;
+		ddOut.resize(3 * haloSend[s].size());
+		double *q = ddOut.data();
+		for (int i : haloSend[s]) {
+			q[0] = mol.rx[i];
+			q[1] = mol.ry[i];
+			q[2] = mol.rz[i];
+			q[d] += haloShift[s];
+			q += 3;
+		}
+		commExchange((k == 0) ? procLo[d] : procHi[d], ddOut,
+			(k == 0) ? procHi[d] : procLo[d], ddIn);
+		for (int g = 0; g < haloCount[s]; g++) {
+			int i = haloFirst[s] + g;
+			mol.rx[i] = ddIn[3*g];
+			mol.ry[i] = ddIn[3*g+1];
+			mol.rz[i] = ddIn[3*g+2];
+		}
+	}
+}
+
+// ghost accelerations go back in reverse stage order and add to the atoms
+// they were copied from, which may be ghosts of an earlier stage
+void Sim::ddHaloReverse() {
+	for (int s = 5; s >= 0; s--) {
+		int d = s / 2, k = s % 2;
+		ddOut.resize(3 * haloCount[s]);
+		for (int g = 0; g < haloCount[s]; g++) {
+			int i = haloFirst[s] + g;
+			ddOut[3*g] = mol.ax[i];
+			ddOut[3*g+1] = mol.ay[i];
+			ddOut[3*g+2] = mol.az[i];
+		}
+		commExchange((k == 0) ? procHi[d] : procLo[d], ddOut,
+			(k == 0) ? procLo[d] : procHi[d], ddIn);
+		const double *q = ddIn.data();
+		for (int i : haloSend[s]) {
+			mol.ax[i] += q[0];
+			mol.ay[i] += q[1];
+			mol.az[i] += q[2];
+			q += 3;
+		}
+	}
+}
+
+// local and ghost atoms into cells at least wid wide over the sub-box and
+// its halo; atoms that drifted past the halo go in the outermost cells
+void Sim::ddBinCells(double wid) {
+	const double *r[] = {mol.rx, mol.ry, mol.rz};
+	int nAll = nLocal + nGhost;
+	double lo[3], inv[3];
+	for (int d = 0; d < 3; d++) {
+		double ext = subHi[d] - subLo[d] + 2 * rHalo;
+		ddCells[d] = std::max(int(ext / wid), 1);
+		lo[d] = subLo[d] - rHalo;
+		inv[d] = ddCells[d] / ext;
+	}
+	int nc = ddCells[0] * ddCells[1] * ddCells[2];
+	ddCellStart.assign(nc + 1, 0);
+	ddCellOf.resize(nAll);
+	ddCellAtom.resize(nAll);
+	for (int i = 0; i < nAll; i++) {
+		int c[3];
+		for (int d = 0; d < 3; d++) {
+			c[d] = std::min(std::max(int(std::floor((r[d][i] - lo[d]) * inv[d])), 0),
+				ddCells[d] - 1);
+		}
+		ddCellOf[i] = c[0] + ddCells[0] * (c[1] + ddCells[1] * c[2]);
+		ddCellStart[ddCellOf[i] + 1]++;
+	}
+	for (int c = 0; c < nc; c++) {
+		ddCellStart[c+1] += ddCellStart[c];
+	}
+	std::vector<int> fill(ddCellStart.begin(), ddCellStart.end() - 1);
+	for (int i = 0; i < nAll; i++) {
+		ddCellAtom[fill[ddCellOf[i]]++] = i;
+	}
+}
+
+// the cells around cell m, up to 27, clipped at the edge of the halo
+int Sim::ddCellNebrs(int m, int *m2) {
+	int cx = m % ddCells[0], cy = (m / ddCells[0]) % ddCells[1];
+	int cz = m / (ddCells[0] * ddCells[1]), n = 0;
+	for (int z = std::max(cz - 1, 0); z <= std::min(cz + 1, ddCells[2] - 1); z++) {
+		for (int y = std::max(cy - 1, 0); y <= std::min(cy + 1, ddCells[1] - 1); y++) {
+			for (int x = std::max(cx - 1, 0); x <= std::min(cx + 1, ddCells[0] - 1); x++) {
+				m2[n++] = x + ddCells[0] * (y + ddCells[1] * z);
+			}
+		}
+	}
+	return n;
+}
+
+/*
+ * Half list in the CSR form of buildNebrList() for the local atoms. Each
+ * pair is listed on one rank only: two local atoms by slot, a local atom
+ * and a ghost on the rank whose local atom has the lower id.
+ */
+void Sim::ddBuildNebrList() {
+	double rrNebr = Sqr(rCut + rNebrShell);
+	const double *rx = mol.rx, *ry = mol.ry, *rz = mol.rz;
+	const int *id = mol.id;
+	ddBinCells(rCut + rNebrShell);
+
+	std::vector<int> &buff = nebrBuff[0];
+	buff.clear();
+	nebrStart[0] = 0;
+	for (int j1 = 0; j1 < nLocal; j1++) {
+		int m2[27], nNebr = ddCellNebrs(ddCellOf[j1], m2);
+		for (int k = 0; k < nNebr; k++) {
+			for (int p = ddCellStart[m2[k]]; p < ddCellStart[m2[k]+1]; p++) {
+				int j2 = ddCellAtom[p];
+				if ((j2 < nLocal) ? j2 < j1 : id[j1] < id[j2]) {
+					double dx = rx[j1] - rx[j2], dy = ry[j1] - ry[j2], dz = rz[j1] - rz[j2];
+					if (dx*dx + dy*dy + dz*dz < rrNebr) {
+						buff.push_back(j2);
+					}
+				}
+			}
+		}
+		nebrStart[j1+1] = buff.size();
+	}
+	nebrTabLen = buff.size();
+	if (nebrTabLen > nebrTabMax) {
+		growNebrTab();
+	}
+	std::copy(buff.begin(), buff.end(), nebrTab);
+
+	std::copy(rx, rx + nLocal, nebrRx);
+	std::copy(ry, ry + nLocal, nebrRy);
+	std::copy(rz, rz + nLocal, nebrRz);
+}
+
+// called by every thread of the team in evalRdf(), after ddBinCells(rHalo)
+void Sim::ddRdfPairs(double *hist, double deltaR) {
+	const int *id = mol.id;
+	#pragma omp for schedule(dynamic, 64)
+	for (int j1 = 0; j1 < nLocal; j1++) {
+		int m2[27], nNebr = ddCellNebrs(ddCellOf[j1], m2);
+		for (int k = 0; k < nNebr; k++) {
+			for (int p = ddCellStart[m2[k]]; p < ddCellStart[m2[k]+1]; p++) {
+				int j2 = ddCellAtom[p];
+				if ((j2 < nLocal) ? j2 < j1 : id[j1] < id[j2]) {
+					rdfPair(hist, j1, j2, deltaR);
+				}
+			}
+		}
+	}
+}
+
+// positions by atom id, wrapped into the box, on rank 0, which passes the
+// arrays; the others only send
+void Sim::ddGather(double *x, double *y, double *z) {
+	ddOut.clear();
+	for (int i = 0; i < nLocal; i++) {
+		vecR r;
+		vecSet(r, mol.rx[i], mol.ry[i], mol.rz[i]);
+		vecWrapAll(r, region);
+		ddOut.insert(ddOut.end(), {double(mol.id[i]), r.x, r.y, r.z});
+	}
+	if (rank > 0) {
+		commSend(0, ddOut);
+		return;
+	}
+	for (int r = 0; r < nRank; r++) {
+		if (r > 0) {
+			commRecv(r, ddIn);
+		}
+		const std::vector<double> &in = (r > 0) ? ddIn : ddOut;
+		for (size_t p = 0; p < in.size(); p += 4) {
+			int n = int(in[p]);
+			x[n] = in[p+1];
+			y[n] = in[p+2];
+			z[n] = in[p+3];
+		}
+	}
+}
+
+// sums (or maxima) over the ranks, in place
+void Sim::reduceAll(double *v, int n, int op) {
+	if (nRank > 1) {
+		perfStart(perfSecs, PERF_COMM);
+		commAllreduce(v, n, op);
+		perfStop();
+	}
+}
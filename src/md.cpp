@@ -0,0 +1,2291 @@
+#include <iostream>
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <vector>
+#include <complex>
+#include <cstdlib>
+#include <cstdio>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "types.hpp"
+#include "vec_cal.hpp"
+#include "pair_force.hpp"
+#include "traj.hpp"
+#include "async_out.hpp"
+#include "correl.hpp"
+#include "config.hpp"
+#include "comm.hpp"
+#include "perf.hpp"
+#include "arena.hpp"
+#include "md.hpp"
+
+void allocMol(Arena &, Mol &, int);
+double integrate(double *, int);
+
+/*
+ * Sets up a run from the keys of its input file dot_in and, if dot_ckpt is
+ * not empty, resumes it from that checkpoint; 0 on bad input. An empty
+ * dot_in opens no output files.
+ */
+int Sim::initRun(std::map<std::string, std::string> &cfg, std::string dot_in,
+		std::string dot_ckpt) {
+	// run parameters: the defaults below are overridden by the key = value
+	// lines of the input file, under the names in the cfgGet() calls
+	temperature = 0.8;
+	density = 1.2;
+	num_atoms = 864;
+	mRatio = 1.0;
+	deltaT = 0.005;
+	cfgGet(cfg, "temperature", temperature);
+	cfgGet(cfg, "density", density);
+	cfgGet(cfg, "num_atoms", num_atoms);
+	cfgGet(cfg, "mass_ratio", mRatio);
+	cfgGet(cfg, "delta_t", deltaT);
+	double num_unit_cell = int(std::pow(num_atoms/4, 1/3.0)+0.5);
+	initUcell = {num_unit_cell, num_unit_cell, num_unit_cell};
+
+	nDim = 3;
+	rCut = 3;
+	stepEquil = 10000;
+	stepRun = 10000;
+	stepAdjTemp = 20;
+	stepAvg = 50;
+	stepDump = 100;
+	cfgGet(cfg, "r_cut", rCut);
+	cfgGet(cfg, "step_equil", stepEquil);
+	cfgGet(cfg, "step_run", stepRun);
+	cfgGet(cfg, "step_adj_temp", stepAdjTemp);
+	cfgGet(cfg, "step_avg", stepAvg);
+	cfgGet(cfg, "step_dump", stepDump);
+	stepLimit = stepEquil + stepRun;
+
+	// LJ parameters per species pair
+	cfgGet(cfg, "eps_aa", epsAA);
+	cfgGet(cfg, "eps_bb", epsBB);
+	cfgGet(cfg, "eps_ab", epsAB);
+	cfgGet(cfg, "sig_aa", sigAA);
+	cfgGet(cfg, "sig_bb", sigBB);
+	cfgGet(cfg, "sig_ab", sigAB);
+
+	// dump format: text (.dump) or binary float, double, packed (.trj);
+	// prec is the packed position resolution
+	std::string trajMode = "text";
+	trajInfo.prec = 1e-3;
+	cfgGet(cfg, "traj_mode", trajMode);
+	cfgGet(cfg, "traj_prec", trajInfo.prec);
+	const char *trajModes[] = {"text", "float", "double", "packed"};
+	trajInfo.mode = std::find(trajModes, trajModes + 4, trajMode) - trajModes;
+	if (trajInfo.mode == 4) {
+		std::cerr << dot_in << ": unknown traj_mode " << trajMode << '\n';
+		return 0;
+	}
+
+	// rdf parameters
+	limitRdf = 200;
+	rangeRdf = 4;
+	sizeHistRdf = 200;
+	cfgGet(cfg, "limit_rdf", limitRdf);
+	cfgGet(cfg, "range_rdf", rangeRdf);
+	cfgGet(cfg, "size_hist_rdf", sizeHistRdf);
+
+	// diffusivity parameters
+	stepDiff = 10;
+	nValDiff = 500;
+	nBuffDiff = 50;
+	cfgGet(cfg, "step_diff", stepDiff);
+	cfgGet(cfg, "n_val_diff", nValDiff);
+	cfgGet(cfg, "n_buff_diff", nBuffDiff);
+
+	// VACF parameters
+	stepAcf = stepDiff;
+	nValAcf = nValDiff;
+	nBuffAcf = nBuffDiff;
+	cfgGet(cfg, "step_acf", stepAcf);
+	cfgGet(cfg, "n_val_acf", nValAcf);
+	cfgGet(cfg, "n_buff_acf", nBuffAcf);
+
+	// MSD and VACF: corr_mode 0 uses the staggered buffers above; 1 takes
+	// blocks of nCorr samples of unwrapped positions and velocities,
+	// correlated over every time origin by FFT; 2 is a multiple-tau
+	// correlator with nLevTau levels of pTau samples, each level mTau
+	// times coarser than the one below, reported at the end of the run
+	nCorr = 2 * nValDiff;
+	nLevTau = 16;
+	pTau = 16;
+	mTau = 2;
+	cfgGet(cfg, "corr_mode", corr_mode);
+	cfgGet(cfg, "n_corr", nCorr);
+	cfgGet(cfg, "n_lev_tau", nLevTau);
+	cfgGet(cfg, "p_tau", pTau);
+	cfgGet(cfg, "m_tau", mTau);
+	if (corr_mode) {
+		nBuffDiff = 0;
+		nBuffAcf = 0;
+	}
+
+	// checkpoint every stepCkpt steps (0 = never) to .ckpt, and once at the
+	// end of equilibration to .equil.ckpt; resume with: a.out x.in x.ckpt
+	stepCkpt = 1000;
+	cfgGet(cfg, "step_ckpt", stepCkpt);
+	ckptBase = dot_in.substr(0, dot_in.length()-2);
+
+	// output streams: buffer size per stream, flush interval (0 = at exit)
+	sizeOutBuff = 1 << 20;
+	stepFlush = 0;
+	cfgGet(cfg, "size_out_buff", sizeOutBuff);
+	cfgGet(cfg, "step_flush", stepFlush);
+
+	// frames queued for the output thread (0 = write synchronously)
+	nOutSlot = 8;
+	cfgGet(cfg, "n_out_slot", nOutSlot);
+
+	// for neighbor list
+	nebrTabFac = 100;
+	rNebrShell = 0.4;
+	nebrNow = 1;
+	nebrCount = 0;
+	cfgGet(cfg, "nebr_tab_fac", nebrTabFac);
+	cfgGet(cfg, "r_nebr_shell", rNebrShell);
+	cfgGet(cfg, "sort_atoms", sort_atoms);
+
+	// r-RESPA: pair forces within rRespa every step, the rest only every
+	// nRespa steps with nRespa times the kick (1 = off)
+	rRespa = 2.5;
+	cfgGet(cfg, "n_respa", nRespa);
+	cfgGet(cfg, "r_respa", rRespa);
+
+	// adaptive skin, tuned between 0.1 and rNebrShellMax
+	rNebrShellMax = 1.0;
+	stepNebrAdapt = 200;
+	nebrShellDir = 1;
+	nebrCostPrev = 0;
+	nebrWinTime = 0;
+	nebrWinSteps = 0;
+	cfgGet(cfg, "nebr_adapt", nebr_adapt);
+	cfgGet(cfg, "r_nebr_shell_max", rNebrShellMax);
+	cfgGet(cfg, "step_nebr_adapt", stepNebrAdapt);
+
+	// threads (0 = OMP_NUM_THREADS); one force buffer per thread
+	int threads = 0;
+	cfgGet(cfg, "threads", threads);
+	nThreads = 1;
+#ifdef _OPENMP
+	nThreads = (threads > 0) ? threads : omp_get_max_threads();
+#endif
+
+	// widest SIMD pair kernel the CPU supports, or avx512, avx2, scalar
+	std::string kernel = "auto";
+	cfgGet(cfg, "pair_kernel", kernel);
+	pairKernel = selectPairKernel(kernel);
+	if (!pairKernel) {
+		std::cerr << dot_in << ": pair_kernel " << kernel << " not supported here\n";
+		return 0;
+	}
+
+	// anything left is misspelt or did not parse
+	for (auto &kv : cfg) {
+		std::cerr << dot_in << ": unknown key or bad value: "
+			<< kv.first << " = " << kv.second << '\n';
+	}
+	if (!cfg.empty()) {
+		return 0;
+	}
+
+	// intervals, counts, sizes and the state point must be positive; run
+	// lengths, checkpoint and flush intervals and n_out_slot may be 0
+	struct {
+		const char *key;
+		double val;
+		int zeroOk;
+	} bounds[] = {
+		{"temperature", temperature, 0}, {"density", density, 0},
+		{"mass_ratio", mRatio, 0}, {"delta_t", deltaT, 0}, {"r_cut", rCut, 0},
+		{"step_equil", double(stepEquil), 1}, {"step_run", double(stepRun), 1},
+		{"step_adj_temp", double(stepAdjTemp), 0}, {"step_avg", double(stepAvg), 0},
+		{"step_dump", double(stepDump), 0}, {"limit_rdf", double(limitRdf), 0},
+		{"range_rdf", rangeRdf, 0}, {"size_hist_rdf", double(sizeHistRdf), 0},
+		{"step_diff", double(stepDiff), 0}, {"n_val_diff", double(nValDiff), 0},
+		{"n_buff_diff", double(nBuffDiff), 1}, {"step_acf", double(stepAcf), 0},
+		{"n_val_acf", double(nValAcf), 0}, {"n_buff_acf", double(nBuffAcf), 1},
+		{"n_corr", double(nCorr), 0}, {"n_lev_tau", double(nLevTau), 0},
+		{"p_tau", double(pTau), 0}, {"m_tau", double(mTau), 0},
+		{"step_ckpt", double(stepCkpt), 1}, {"size_out_buff", double(sizeOutBuff), 0},
+		{"step_flush", double(stepFlush), 1}, {"n_out_slot", double(nOutSlot), 1},
+		{"nebr_tab_fac", double(nebrTabFac), 0}, {"r_nebr_shell", rNebrShell, 0},
+		{"r_nebr_shell_max", rNebrShellMax, 0},
+		{"step_nebr_adapt", double(stepNebrAdapt), 0},
+	};
+	for (auto &b : bounds) {
+		if (b.zeroOk ? !(b.val >= 0) : !(b.val > 0)) {
+			std::cerr << dot_in << ": " << b.key << " must be "
+				<< (b.zeroOk ? "at least 0" : "positive") << '\n';
+			return 0;
+		}
+	}
+	// one unit cell of four atoms at least
+	if (num_unit_cell < 1) {
+		std::cerr << dot_in << ": num_atoms must be at least 4\n";
+		return 0;
+	}
+	stepRdf = std::max(stepRun / limitRdf, 1);
+	limitDiffAvg = (stepRun/stepDiff/nValDiff - 1) * nBuffDiff;
+	limitAcfAvg = (stepRun/stepAcf/nValAcf - 1) * nBuffAcf;
+
+	// on several ranks only rank 0 writes output; what no rank can do on
+	// its own part of the box is left to single rank runs
+	if (commSize() > 1 && (corr_mode || nebr_adapt || !dot_ckpt.empty())) {
+		std::cerr << dot_in << ": corr_mode, nebr_adapt and checkpoints need a single rank\n";
+		return 0;
+	}
+	// corr_mode 1 and 2 sample velocities along with positions
+	if (corr_mode && stepAcf != stepDiff) {
+		std::cerr << dot_in << ": corr_mode " << corr_mode << " needs step_acf = step_diff\n";
+		return 0;
+	}
+	// corr_mode 1 takes every lag from one block of nCorr samples
+	if (corr_mode == 1 && nCorr < std::max(nValDiff, nValAcf)) {
+		std::cerr << dot_in << ": n_corr must be at least n_val_diff and n_val_acf\n";
+		return 0;
+	}
+	// energies are averaged over whole outer steps
+	if (nRespa < 1 || (nRespa > 1 && (rRespa >= rCut || stepAvg % nRespa))) {
+		std::cerr << dot_in << ": n_respa must be at least 1, r_respa below r_cut"
+			" and step_avg a multiple of n_respa\n";
+		return 0;
+	}
+	openOutputs((commRank() == 0) ? dot_in : "");
+
+	setParams();
+	// within half the box an atom meets at most one image of another, so
+	// the neighbor lists hold each pair once
+	double rNebrMax = rCut + (nebr_adapt ? std::max(rNebrShell, rNebrShellMax) : rNebrShell);
+	double sideMin = std::min({region.x, region.y, region.z});
+	if (rNebrMax > 0.5 * sideMin) {
+		std::cerr << dot_in << ": r_cut plus the skin, " << rNebrMax
+			<< ", is more than half the box side " << sideMin << '\n';
+		return 0;
+	}
+	// packed positions are counted in steps of prec from the lowest, in 32
+	// bits; the box side in 2^31 steps leaves room for atoms that stray
+	// out of it between rebuilds
+	double side = std::max({region.x, region.y, region.z});
+	if (trajInfo.mode == TRAJ_PACKED && !(trajInfo.prec > 0 && side / trajInfo.prec < 0x1p31)) {
+		std::cerr << dot_in << ": traj_prec too fine for packed positions in a box of side "
+			<< side << '\n';
+		return 0;
+	}
+	nebrBuff.resize(nThreads);
+	bufferAA.resize(nBuffDiff);
+	bufferBB.resize(nBuffDiff);
+	bufferAB.resize(nBuffDiff);
+	vacBuff.resize(nBuffAcf);
+	Arena sizing;
+	allocRun(sizing);
+	arenaReserve(arena, sizing.used);
+	allocRun(arena);
+	trajInfo.nMol = nMol;
+	if (corr_mode == 2) {
+		initMultiTau();
+	}
+
+	countRdf = 0;
+	countCorr = 0;
+	uLong = 0;
+	virLong = 0;
+	nLocal = nMol;
+	nGhost = 0;
+	initAtoms();
+	accumProps(0);
+	initDiffusion();
+	initVacf();
+	stepStart = 0;
+	if (!dot_ckpt.empty() && !readCheckpoint(dot_ckpt)) {
+		std::cerr << dot_ckpt << ": not a checkpoint of this system\n";
+		return 0;
+	}
+
+	for (int n = 0; n < nMol; n++) {
+		trajInfo.type[n] = mol.type[molSlot[n]];
+	}
+	if (trajInfo.mode != TRAJ_TEXT) {
+		trajWriteHeader(dumpFile, trajInfo);
+	}
+	if (!ddInit()) {
+		std::cerr << dot_in << ": box too small to split among " << commSize() << " ranks\n";
+		return 0;
+	}
+	asyncOut = new AsyncOut;
+	asyncOutStart(*asyncOut, nOutSlot, std::max({3 * nMol, (1 + nPairRdf) * sizeHistRdf,
+		4 * nValDiff, 2 * nValAcf, 4 * pTau * nLevTau, 6}),
+		[this](OutFrame &f) { writeFrame(f); });
+	pairCount = 0;
+	std::fill(perfSecs, perfSecs + N_PERF, 0.0);
+	return 1;
+}
+
+// the remaining steps of the run
+void Sim::runSteps() {
+	nStepRun = stepLimit - stepStart;
+	auto startRun = std::chrono::steady_clock::now();
+	for (stepCount = stepStart; stepCount < stepLimit; stepCount++) {
+		singleStep();
+	}
+	if (corr_mode == 2) {
+		perfStart(perfSecs, PERF_DIFF);
+		reportMultiTau();
+		perfStop();
+	}
+	std::chrono::duration<double> secs = std::chrono::steady_clock::now() - startRun;
+	secsRun = secs.count();
+}
+
+// writes what is still queued and closes the output of the run, ending
+// with the total wall time; its buffers go with the Sim
+void Sim::endRun(long secsWall) {
+	asyncOutStop(*asyncOut);
+	delete asyncOut;
+
+	reduceAll(&pairCount, 1, COMM_SUM);
+	if (nRank > 1) {
+		outFile << "Ranks: " << nRank << ", sub-boxes " << procGrid[0] << " x "
+			<< procGrid[1] << " x " << procGrid[2] << '\n';
+	}
+	outFile << "Neighbor list rebuilds: " << nebrCount
+		<< ", average interval: " << double(stepLimit) / std::max(nebrCount, 1)
+		<< " steps, skin: " << rNebrShell << '\n';
+	printPerf();
+	outFile << "Wall time: " << secsWall << " seconds\n";
+	closeOutputs();
+}
+
+// every output file is opened once, in append mode, with a large buffer
+void Sim::openOutputs(std::string dot_in) {
+	if (dot_in.empty()) {
+		return;
+	}
+	std::string base = dot_in.substr(0, dot_in.length()-2);
+	std::ofstream *files[] = {&outFile, &dumpFile, &rdfFile, &msdFile, &dfsFile, &acfFile};
+	const char *ext[] = {"out", "dump", "rdf", "msd", "dfs", "acf"};
+	std::ios::openmode mode[6];
+	std::fill(mode, mode + 6, std::ofstream::app);
+	if (trajInfo.mode != TRAJ_TEXT) {
+		ext[1] = "trj";
+		mode[1] |= std::ofstream::binary;
+	}
+
+	for (int k = 0; k < 6; k++) {
+		outBuff[k].resize(sizeOutBuff);
+		files[k]->rdbuf()->pubsetbuf(outBuff[k].data(), sizeOutBuff);
+		files[k]->open(base + ext[k], mode[k]);
+	}
+}
+
+void Sim::flushOutputs() {
+	perfStart(perfSecs, PERF_OUTPUT);
+	OutFrame *f = asyncOutAcquire(*asyncOut);
+	f->kind = OUT_FLUSH;
+	asyncOutPublish(*asyncOut);
+	perfStop();
+}
+
+void Sim::closeOutputs() {
+	outFile.close();
+	dumpFile.close();
+	rdfFile.close();
+	msdFile.close();
+	dfsFile.close();
+	acfFile.close();
+}
+
+template <typename T>
+void ckptArr(std::fstream &f, int save, T *p, long n) {
+	if (save) {
+		f.write(reinterpret_cast<const char *>(p), n * sizeof(T));
+	} else {
+		f.read(reinterpret_cast<char *>(p), n * sizeof(T));
+	}
+}
+
+/*
+ * Everything the remaining steps depend on, in one list used for both
+ * writing and reading. Input parameters and what initAtoms() derives from
+ * them are not stored; the velocities come from a local RNG that is not
+ * used after initAtoms(), so there is no RNG state either. Forces are
+ * summed per thread, so a bit-exact resume needs the same thread count.
+ */
+void Sim::ckptState(std::fstream &f, int save) {
+	ckptArr(f, save, &stepStart, 1);
+	ckptArr(f, save, &nebrTabLen, 1);
+	if (!save && nebrTabLen > nebrTabMax) {
+		growNebrTab();
+	}
+
+	double *molArr[] = {mol.rx, mol.ry, mol.rz, mol.vx, mol.vy, mol.vz,
+		mol.ax, mol.ay, mol.az, mol.mass};
+	for (double *a : molArr) {
+		ckptArr(f, save, a, nMol);
+	}
+	ckptArr(f, save, mol.type, nMol);
+	ckptArr(f, save, mol.id, nMol);
+	ckptArr(f, save, mol.imx, nMol);
+	ckptArr(f, save, mol.imy, nMol);
+	ckptArr(f, save, mol.imz, nMol);
+	ckptArr(f, save, molSlot, nMol);
+
+	ckptArr(f, save, nebrTab, nebrTabLen);
+	ckptArr(f, save, nebrStart, nMol + 1);
+	ckptArr(f, save, nebrRx, nMol);
+	ckptArr(f, save, nebrRy, nMol);
+	ckptArr(f, save, nebrRz, nMol);
+	ckptArr(f, save, &nebrNow, 1);
+	ckptArr(f, save, &nebrCount, 1);
+	ckptArr(f, save, &rNebrShell, 1);
+	ckptArr(f, save, &nebrShellDir, 1);
+	ckptArr(f, save, &nebrCostPrev, 1);
+	if (nRespa > 1) {
+		ckptArr(f, save, &nebrTabLenIn, 1);
+		ckptArr(f, save, nebrTabIn, nebrTabLenIn);
+		ckptArr(f, save, nebrStartIn, nMol + 1);
+		ckptArr(f, save, alx, nMol);
+		ckptArr(f, save, aly, nMol);
+		ckptArr(f, save, alz, nMol);
+		ckptArr(f, save, &uLong, 1);
+		ckptArr(f, save, &virLong, 1);
+	}
+
+	ckptArr(f, save, &kinEnergy, 1);
+	ckptArr(f, save, &totEnergy, 1);
+	ckptArr(f, save, &pressure, 1);
+	ckptArr(f, save, &momSum, 1);
+	ckptArr(f, save, &uSum, 1);
+	ckptArr(f, save, &virSum, 1);
+	ckptArr(f, save, &latticeCorr, 1);
+
+	ckptArr(f, save, histRdf, nPairRdf * sizeHistRdf);
+	ckptArr(f, save, &countRdf, 1);
+
+	for (int nb = 0; nb < nBuffDiff; nb++) {
+		Tbuff *buff[] = {&bufferAA[nb], &bufferBB[nb], &bufferAB[nb]};
+		int nOrg[] = {nMolA, nMolB, 0};
+		for (int k = 0; k < 3; k++) {
+			ckptArr(f, save, buff[k]->orgR, nOrg[k]);
+			ckptArr(f, save, buff[k]->orgIm, nOrg[k]);
+			ckptArr(f, save, buff[k]->rrDiff, nValDiff);
+			ckptArr(f, save, &buff[k]->count, 1);
+		}
+	}
+	ckptArr(f, save, rrDiffAvgAA, nValDiff);
+	ckptArr(f, save, rrDiffAvgBB, nValDiff);
+	ckptArr(f, save, rrDiffAvgAB, nValDiff);
+	ckptArr(f, save, &countDiffAvg, 1);
+
+	for (int nb = 0; nb < nBuffAcf; nb++) {
+		ckptArr(f, save, vacBuff[nb].orgVel, nMol);
+		ckptArr(f, save, vacBuff[nb].acfVel, nValAcf);
+		ckptArr(f, save, &vacBuff[nb].count, 1);
+	}
+	ckptArr(f, save, avgAcfVel, nValAcf);
+	ckptArr(f, save, &countAcfAvg, 1);
+	ckptArr(f, save, &intAcfVel, 1);
+
+	if (corr_mode == 1) {
+		ckptArr(f, save, corrPos, 3L * nMol * nCorr);
+		ckptArr(f, save, corrVel, 3L * nMol * nCorr);
+		ckptArr(f, save, &countCorr, 1);
+	}
+	if (corr_mode == 2) {
+		ckptArr(f, save, tauPos, 3L * nRowTau * pTau * nLevTau);
+		ckptArr(f, save, tauVel, 3L * nMol * pTau * nLevTau);
+		ckptArr(f, save, tauVelAcc, 3L * nMol * (nLevTau + 1));
+		ckptArr(f, save, tauMsd, 3 * pTau * nLevTau);
+		ckptArr(f, save, tauAcf, pTau * nLevTau);
+		ckptArr(f, save, tauCount, pTau * nLevTau);
+		ckptArr(f, save, tauFill, nLevTau);
+		ckptArr(f, save, tauHead, nLevTau);
+		ckptArr(f, save, tauAccN, nLevTau);
+		ckptArr(f, save, &countTau, 1);
+	}
+}
+
+/*
+ * The format version, then the sizes and settings the arrays of a
+ * checkpoint are laid out by; the inner r-RESPA list depends on r_respa,
+ * the FFT correlator blocks on corr_mode and n_corr and the multiple-tau
+ * levels on p_tau, n_lev_tau and m_tau. Doubles, so that settings fit
+ * beside the sizes.
+ */
+std::vector<double> Sim::ckptHeader() {
+	return {4, double(nMol), double(nThreads), double(nPairRdf * sizeHistRdf),
+		double(nValDiff), double(nBuffDiff), double(nValAcf), double(nBuffAcf),
+		double(nRespa), (nRespa > 1) ? rRespa : 0, double(corr_mode),
+		double((corr_mode == 1) ? nCorr : 0), double((corr_mode == 2) ? pTau : 0),
+		double((corr_mode == 2) ? nLevTau : 0), double((corr_mode == 2) ? mTau : 0)};
+}
+
+// the checkpoint starts with its header and the header's length
+void Sim::writeCheckpoint(std::string name) {
+	std::vector<double> head = ckptHeader();
+	int nHead = head.size();
+	std::fstream f(name + ".tmp", std::fstream::out | std::fstream::binary);
+	f.write("ATMCKPT", 8);
+	ckptArr(f, 1, &nHead, 1);
+	ckptArr(f, 1, head.data(), nHead);
+	stepStart = stepCount + 1;
+	ckptState(f, 1);
+	f.close();
+	std::rename((name + ".tmp").c_str(), name.c_str());
+}
+
+int Sim::readCheckpoint(std::string name) {
+	std::vector<double> head = ckptHeader(), headCkpt(head.size());
+	int nHead = 0;
+	char magic[8];
+	std::fstream f(name, std::fstream::in | std::fstream::binary);
+	f.read(magic, 8);
+	ckptArr(f, 0, &nHead, 1);
+	if (!f || std::string(magic, 7) != "ATMCKPT" || nHead != int(head.size())) {
+		return 0;
+	}
+	ckptArr(f, 0, headCkpt.data(), nHead);
+	for (int k = 0; k < nHead; k++) {
+		if (!f || (k != 2 && headCkpt[k] != head[k])) {
+			return 0;
+		}
+	}
+	if (headCkpt[2] != nThreads) {
+		std::cerr << name << ": written with " << headCkpt[2]
+			<< " threads, the run will not repeat bit for bit\n";
+	}
+	ckptState(f, 0);
+	// and nothing after the state
+	return f.good() && f.peek() == std::fstream::traits_type::eof();
+}
+
+void Sim::setParams() {
+	vecScaleCopy(region, 1.0/std::pow(density/4.0, 1/3.0), initUcell);
+	// cells at least as wide as the largest neighbor range
+	double rNebrMax = rCut + (nebr_adapt ? rNebrShellMax : rNebrShell);
+	vecScaleCopy(cells, 1.0/rNebrMax, region);
+	vecFloor(cells);
+	vecSet(cells, std::max(cells.x, 2.0), std::max(cells.y, 2.0), std::max(cells.z, 2.0));
+	nCell = int(vecProd(cells)+0.5);
+	// RDF cells at least rangeRdf wide
+	vecScaleCopy(cellsRdf, 1.0/rangeRdf, region);
+	vecFloor(cellsRdf);
+	vecSet(cellsRdf, std::max(cellsRdf.x, 1.0), std::max(cellsRdf.y, 1.0),
+		std::max(cellsRdf.z, 1.0));
+	nCellRdf = int(vecProd(cellsRdf)+0.5);
+	nMol = 4 * int(vecProd(initUcell)+0.5);
+	// every fifth atom is of species B, as initAtoms() lays them out
+	nMolB = (nMol + 4) / 5;
+	nMolA = nMol - nMolB;
+	// slots for atoms; a domain decomposed run may need more later.
+	// Per-thread buffers start on a cache line boundary
+	nMolMax = nMol;
+	nMolPad = ((nMolMax + 7) / 8) * 8;
+	nebrTabMax = nebrTabFac * nMol;
+	// one extra multiple-tau position row for the summed positions of
+	// species A
+	nRowTau = nMol + 1;
+
+	// LJ coefficient table indexed by (type-1)*nType + (type-1)
+	nType = 2;
+	double epsTab[] = {epsAA, epsAB, epsAB, epsBB};
+	double sigTab[] = {sigAA, sigAB, sigAB, sigBB};
+	double rri6 = 1.0 / Cub(Sqr(rCut)), rri6In = 1.0 / Cub(Sqr(rRespa));
+	ljTab.resize(nType*nType);
+	ljTabIn.resize(nType*nType);
+	for (int k = 0; k < nType*nType; k++) {
+		double sig6 = Cub(Sqr(sigTab[k]));
+		ljTab[k].fc12 = 48.0 * epsTab[k] * Sqr(sig6);
+		ljTab[k].fc6 = 24.0 * epsTab[k] * sig6;
+		ljTab[k].rrCut = Sqr(rCut);
+		ljTab[k].uShift = 4.0 * epsTab[k] * sig6 * rri6 * (sig6 * rri6 - 1.0);
+		// the short range part for r-RESPA, cut and shifted at rRespa
+		ljTabIn[k] = ljTab[k];
+		ljTabIn[k].rrCut = Sqr(rRespa);
+		ljTabIn[k].uShift = 4.0 * epsTab[k] * sig6 * rri6In * (sig6 * rri6In - 1.0);
+	}
+
+	// RDF column of each type pair: like pairs first (AA, BB, ...), then
+	// unlike ones (AB, AC, ..., BC, ...); per-thread histograms are padded
+	// to whole cache lines
+	nPairRdf = nType * (nType + 1) / 2;
+	rdfPairCol.resize(nType*nType);
+	int col = 0;
+	for (int t = 0; t < nType; t++) {
+		rdfPairCol[t*nType + t] = col++;
+	}
+	for (int t1 = 0; t1 < nType; t1++) {
+		for (int t2 = t1 + 1; t2 < nType; t2++) {
+			rdfPairCol[t1*nType + t2] = rdfPairCol[t2*nType + t1] = col++;
+		}
+	}
+	sizeHistRdfPad = ((nPairRdf * sizeHistRdf + 7) / 8) * 8;
+}
+
+/*
+ * Every buffer whose size the input fixes, out of one arena: called on an
+ * empty arena to size it, then on the reserved one to hand them out. They
+ * start zeroed.
+ */
+void Sim::allocRun(Arena &a) {
+	allocSlots(a);
+	allocMol(a, molTmp, nMol);
+	molSlot = arenaAlloc<int>(a, nMol);
+	typeIdx = arenaAlloc<int>(a, nMol);
+	trajInfo.type = arenaAlloc<int>(a, nMol);
+	cellStart = arenaAlloc<int>(a, nCell + 1);
+	cellAtom = arenaAlloc<int>(a, nMol);
+	cellOf = arenaAlloc<int>(a, nMol);
+	cellCount = arenaAlloc<int>(a, nThreads * nCell);
+	nebrTab = arenaAlloc<int>(a, nebrTabMax);
+	nebrTabIn = arenaAlloc<int>(a, (nRespa > 1) ? nebrTabMax : 0);
+	nebrOff = arenaAlloc<int>(a, nMol);
+	histRdf = arenaAlloc<double>(a, nPairRdf * sizeHistRdf);
+	histRdfThr = arenaAlloc<double>(a, nThreads * sizeHistRdfPad);
+	// a cache line of step sums per thread
+	propThr = arenaAlloc<double>(a, 8L * nThreads);
+	rdfCellStart = arenaAlloc<int>(a, nCellRdf + 1);
+	rdfCellAtom = arenaAlloc<int>(a, nMol);
+	rdfCellOf = arenaAlloc<int>(a, nMol);
+	rrDiffAvgAA = arenaAlloc<double>(a, nValDiff);
+	rrDiffAvgBB = arenaAlloc<double>(a, nValDiff);
+	rrDiffAvgAB = arenaAlloc<double>(a, nValDiff);
+	// origins only for the species a buffer follows; AB needs none
+	for (int nb = 0; nb < nBuffDiff; nb++) {
+		bufferAA[nb].orgR = arenaAlloc<vecR>(a, nMolA);
+		bufferAA[nb].orgIm = arenaAlloc<vecI>(a, nMolA);
+		bufferAA[nb].rrDiff = arenaAlloc<double>(a, nValDiff);
+		bufferBB[nb].orgR = arenaAlloc<vecR>(a, nMolB);
+		bufferBB[nb].orgIm = arenaAlloc<vecI>(a, nMolB);
+		bufferBB[nb].rrDiff = arenaAlloc<double>(a, nValDiff);
+		bufferAB[nb].rrDiff = arenaAlloc<double>(a, nValDiff);
+	}
+	avgAcfVel = arenaAlloc<double>(a, nValAcf);
+	for (int nb = 0; nb < nBuffAcf; nb++) {
+		vacBuff[nb].acfVel = arenaAlloc<double>(a, nValAcf);
+		vacBuff[nb].orgVel = arenaAlloc<vecR>(a, nMol);
+	}
+	if (corr_mode) {
+		corrRUnw = arenaAlloc<vecR>(a, nMol);
+	}
+	if (corr_mode == 1) {
+		corrPos = arenaAlloc<double>(a, 3L * nMol * nCorr);
+		corrVel = arenaAlloc<double>(a, 3L * nMol * nCorr);
+	}
+	if (corr_mode == 2) {
+		tauPos = arenaAlloc<double>(a, 3L * nRowTau * pTau * nLevTau);
+		tauVel = arenaAlloc<double>(a, 3L * nMol * pTau * nLevTau);
+		tauPosNow = arenaAlloc<double>(a, 3L * nRowTau);
+		tauVelAcc = arenaAlloc<double>(a, 3L * nMol * (nLevTau + 1));
+		tauMsd = arenaAlloc<double>(a, 3 * pTau * nLevTau);
+		tauAcf = arenaAlloc<double>(a, pTau * nLevTau);
+		tauCount = arenaAlloc<double>(a, pTau * nLevTau);
+		tauFill = arenaAlloc<int>(a, nLevTau);
+		tauHead = arenaAlloc<int>(a, nLevTau);
+		tauAccN = arenaAlloc<int>(a, nLevTau);
+	}
+}
+
+// everything indexed by atom slot, nMolMax long
+void Sim::allocSlots(Arena &a) {
+	allocMol(a, mol, nMolMax);
+	accBuff = arenaAlloc<double>(a, 3L * nThreads * nMolPad);
+	nebrStart = arenaAlloc<int>(a, nMolMax + 1);
+	nebrRx = arenaAlloc<double>(a, nMolMax);
+	nebrRy = arenaAlloc<double>(a, nMolMax);
+	nebrRz = arenaAlloc<double>(a, nMolMax);
+	int nIn = (nRespa > 1) ? nMolMax : 0;
+	nebrStartIn = arenaAlloc<int>(a, nIn + 1);
+	alx = arenaAlloc<double>(a, nIn);
+	aly = arenaAlloc<double>(a, nIn);
+	alz = arenaAlloc<double>(a, nIn);
+}
+
+// separate x/y/z arrays, each on a cache line of its own
+void allocMol(Arena &a, Mol &m, int n) {
+	m.rx = arenaAlloc<double>(a, n);
+	m.ry = arenaAlloc<double>(a, n);
+	m.rz = arenaAlloc<double>(a, n);
+	m.vx = arenaAlloc<double>(a, n);
+	m.vy = arenaAlloc<double>(a, n);
+	m.vz = arenaAlloc<double>(a, n);
+	m.ax = arenaAlloc<double>(a, n);
+	m.ay = arenaAlloc<double>(a, n);
+	m.az = arenaAlloc<double>(a, n);
+	m.mass = arenaAlloc<double>(a, n);
+	m.type = arenaAlloc<int>(a, n);
+	m.id = arenaAlloc<int>(a, n);
+	m.imx = arenaAlloc<int>(a, n);
+	m.imy = arenaAlloc<int>(a, n);
+	m.imz = arenaAlloc<int>(a, n);
+}
+
+// room for nebrTabLen pairs and a quarter more, in the inner list too;
+// tables longer than the run started with get an arena of their own, and
+// the one before it goes
+void Sim::growNebrTab() {
+	nebrTabMax = nebrTabLen + nebrTabLen / 4;
+	long nIn = (nRespa > 1) ? nebrTabMax : 0;
+	Arena sizing, a;
+	arenaAlloc<int>(sizing, nebrTabMax);
+	arenaAlloc<int>(sizing, nIn);
+	arenaReserve(a, sizing.used);
+	nebrTab = arenaAlloc<int>(a, nebrTabMax);
+	nebrTabIn = arenaAlloc<int>(a, nIn);
+	arenaSwap(arenaNebr, a);
+}
+
+void Sim::initAtoms() {
+	mass2 = 1.0;
+	mass1 = mass2 * mRatio;
+
+	nMolA = 0;
+	nMolB = 0;
+	for (int n = 0; n < nMol; n++) {
+		mol.id[n] = n;
+		molSlot[n] = n;
+		mol.imx[n] = mol.imy[n] = mol.imz[n] = 0;
+		if (n % 5 == 0) {
+			mol.type[n] = 2;
+			mol.mass[n] = mass2;
+			typeIdx[n] = nMolB++;
+		} else {
+			mol.type[n] = 1;
+			mol.mass[n] = mass1;
+			typeIdx[n] = nMolA++;
+		}
+	}
+	nAlpha = nMolA / double(nMol);
+	nBeta = nMolB / double(nMol);
+	Q = 1.0/(nAlpha*nBeta)*Sqr((mRatio*nAlpha)+nBeta);
+
+	vecR c, gap;
+	int n = 0;
+	vecDiv(gap, region, initUcell);
+	for (int nz = 0; nz < initUcell.z; nz++) {
+		for (int ny = 0; ny < initUcell.y; ny++) {
+			for (int nx = 0; nx < initUcell.x; nx++) {
+				vecSet(c, nx+0.25, ny+0.25, nz+0.25);
+				vecMul(c, c, gap);
+				vecScaleAdd(c, c, -0.5, region);
+				for (int j = 0; j < 4; j++) {
+					mol.rx[n] = c.x;
+					mol.ry[n] = c.y;
+					mol.rz[n] = c.z;
+					switch (j) {
+						case 0:
+							mol.rx[n] += 0.5 * gap.x;
+							mol.ry[n] += 0.5 * gap.y;
+							break;
+						case 1:
+							mol.ry[n] += 0.5 * gap.y;
+							mol.rz[n] += 0.5 * gap.z;
+							break;
+						case 2:
+							mol.rz[n] += 0.5 * gap.z;
+							mol.rx[n] += 0.5 * gap.x;
+							break;
+					}
+					n++;
+				}
+			}
+		}
+	}
+
+	// radom velocity generator
+	std::default_random_engine rand_gen;
+	std::normal_distribution<double> normal_dist(0.0, 1.0);
+
+	vecR v;
+	vecSet(momSum, 0, 0, 0);
+	for (int i = 0; i < nMol; i++) {
+		vecSet(v, normal_dist(rand_gen),
+				normal_dist(rand_gen), normal_dist(rand_gen));
+		mol.vx[i] = v.x;
+		mol.vy[i] = v.y;
+		mol.vz[i] = v.z;
+		momSum.x += mol.mass[i] * mol.vx[i];
+		momSum.y += mol.mass[i] * mol.vy[i];
+		momSum.z += mol.mass[i] * mol.vz[i];
+		// assign zero init. acceleration
+		mol.ax[i] = 0;
+		mol.ay[i] = 0;
+		mol.az[i] = 0;
+	}
+
+	// account for COM shift
+	double mv2sum = 0;
+	for (int i = 0; i < nMol; i++) {
+		double s = -1.0/mol.mass[i]/nMol;
+		mol.vx[i] += s * momSum.x;
+		mol.vy[i] += s * momSum.y;
+		mol.vz[i] += s * momSum.z;
+		mv2sum += mol.mass[i] * (mol.vx[i]*mol.vx[i] + mol.vy[i]*mol.vy[i]
+			+ mol.vz[i]*mol.vz[i]);
+	}
+
+	// adjust temperature
+	rescaleVels(mv2sum);
+}
+
+// scales the velocities to the set temperature; mv2sum is the sum of
+// m v^2 over all ranks
+void Sim::rescaleVels(double mv2sum) {
+	double *vx = mol.vx, *vy = mol.vy, *vz = mol.vz;
+	double lambda = std::sqrt(3 * (nMol - 1) * temperature / mv2sum);
+	for (int i = 0; i < nLocal; i++) {
+		vx[i] *= lambda;
+		vy[i] *= lambda;
+		vz[i] *= lambda;
+	}
+}
+
+void Sim::accumProps(int icode) {
+	switch (icode) {
+		case 0:
+			propZero(kinEnergy);
+			propZero(totEnergy);
+			propZero(pressure);
+			break;
+		case 1:
+			propAccum(kinEnergy);
+			propAccum(totEnergy);
+			propAccum(pressure);
+			break;
+		case 2:
+			propAvg(kinEnergy, stepAvg / nRespa);
+			propAvg(totEnergy, stepAvg / nRespa);
+			propAvg(pressure, stepAvg / nRespa);
+			break;
+	}
+}
+
+void Sim::singleStep() {
+	timeNow = stepCount * deltaT;
+
+	perfStart(perfSecs, PERF_INTEGRATE);
+	leapfrogStep(1);
+	perfStop();
+
+	// execute this when neigh_list is on
+	// and nebrNow is 1
+	auto tNebr = std::chrono::steady_clock::now();
+	if (neigh_list && nebrNow) {
+		nebrNow = 0;
+		nebrCount++;
+		if (nRank > 1) {
+			wrapPositions();
+			perfStart(perfSecs, PERF_COMM);
+			ddMigrate();
+			ddHaloBuild();
+			perfStop();
+		}
+		perfStart(perfSecs, PERF_NEBR);
+		if (nRank > 1) {
+			ddBuildNebrList();
+		} else {
+			buildNebrList();
+		}
+		if (nRespa > 1) {
+			buildInnerList();
+		}
+		perfStop();
+	} else if (nRank > 1) {
+		perfStart(perfSecs, PERF_COMM);
+		ddHaloUpdate();
+		perfStop();
+	}
+
+	// on a single rank the second half-kick rides on the pass that sums
+	// the forces; with several, the forces on ghosts come back after it,
+	// and at the end of an outer r-RESPA step the long range ones do
+	int fuse = (nRank == 1 && !(nRespa > 1 && stepCount % nRespa == 0));
+	perfStart(perfSecs, PERF_FORCE);
+	if (nRespa > 1) {
+		respaForces(fuse);
+	} else {
+		computeForces(fuse, 0);
+	}
+	perfStop();
+	if (nebr_adapt) {
+		std::chrono::duration<double> dt = std::chrono::steady_clock::now() - tNebr;
+		adaptNebrShell(dt.count());
+	}
+	if (!fuse) {
+		perfStart(perfSecs, PERF_INTEGRATE);
+		leapfrogStep(2);
+		perfStop();
+	}
+	// with r-RESPA the energy is only conserved over whole outer steps
+	perfStart(perfSecs, PERF_PROPS);
+	evalProps();
+	if (stepCount % nRespa == 0) {
+		accumProps(1);
+	}
+	perfStop();
+
+	// rescale velocities
+	if ((stepCount < stepEquil) && !(stepCount % stepAdjTemp)) {
+		perfStart(perfSecs, PERF_INTEGRATE);
+		rescaleVels(mv2Sum);
+		perfStop();
+	}
+
+	if (stepCount % stepAvg == 0) {
+		perfStart(perfSecs, PERF_PROPS);
+		accumProps(2);
+		evalLatticeCorr();
+		printSummary();
+		accumProps(0);
+		perfStop();
+	}
+
+	if (stepCount % stepDump == 0) {
+		posDump();
+	}
+
+	if (stepFlush && stepCount % stepFlush == 0) {
+		flushOutputs();
+	}
+
+	if (stepCount >= stepEquil && (stepCount - stepEquil) % stepRdf == 0) {
+		perfStart(perfSecs, PERF_RDF);
+		evalRdf();
+		perfStop();
+	}
+
+	if (stepCount >= stepEquil && (stepCount - stepEquil) % stepDiff == 0) {
+		perfStart(perfSecs, PERF_DIFF);
+		if (corr_mode == 1) {
+			evalCorrFft();
+		} else if (corr_mode == 2) {
+			evalMultiTau();
+		} else {
+			evalDiffusion();
+		}
+		perfStop();
+	}
+
+	if (!corr_mode && stepCount >= stepEquil && (stepCount - stepEquil) % stepAcf == 0) {
+		perfStart(perfSecs, PERF_VACF);
+		evalVacf();
+		perfStop();
+	}
+
+	// a checkpoint holds the whole system, so only single rank runs write one
+	perfStart(perfSecs, PERF_CKPT);
+	if (nRank == 1 && stepCkpt && (stepCount + 1) % stepCkpt == 0) {
+		writeCheckpoint(ckptBase + "ckpt");
+	}
+	if (nRank == 1 && stepCount + 1 == stepEquil) {
+		writeCheckpoint(ckptBase + "equil.ckpt");
+	}
+	perfStop();
+}
+
+// an atom that left the box along a side of length len comes back in at
+// the other end, and its image count along that side moves by one
+static inline void wrapCoord(double &r, int &im, double len) {
+	int s = (r >= 0.5 * len) - (r < -0.5 * len);
+	r -= len * s;
+	im += s;
+}
+
+/*
+ * part 1: first half-kick and drift, wrapping positions on the same pass
+ * when this is the only rank; with several they are wrapped only when the
+ * lists are rebuilt, so that ghosts keep the shift they were sent with.
+ * The same pass finds the largest displacement since the last neighbor
+ * list build, so the list is rebuilt before forces use positions it may
+ * no longer cover.
+ * part 2: second half-kick, for runs in which computeForces() cannot do
+ * it; the sums for evalProps() all go to the first thread's row.
+ * With r-RESPA an outer step of nRespa steps opens and closes with half
+ * its long range kick, from the forces found at the end of the last one.
+ */
+void Sim::leapfrogStep(int part) {
+	double *__restrict rx = mol.rx, *__restrict ry = mol.ry, *__restrict rz = mol.rz;
+	double *__restrict vx = mol.vx, *__restrict vy = mol.vy, *__restrict vz = mol.vz;
+	const double *__restrict ax = mol.ax, *__restrict ay = mol.ay, *__restrict az = mol.az;
+	int *__restrict imx = mol.imx, *__restrict imy = mol.imy, *__restrict imz = mol.imz;
+	double hdt = 0.5 * deltaT, hdtLong = hdt * nRespa;
+
+	if (part == 1) {
+		int wrap = (nRank == 1), open = (nRespa > 1 && stepCount % nRespa == 1);
+		double hx = 0.5 * region.x, hy = 0.5 * region.y, hz = 0.5 * region.z;
+		double ddMax = 0;
+		for (int i = 0; i < nLocal; i++) {
+			if (open) {
+				vx[i] += hdtLong * alx[i];
+				vy[i] += hdtLong * aly[i];
+				vz[i] += hdtLong * alz[i];
+			}
+			vx[i] += hdt * ax[i];
+			vy[i] += hdt * ay[i];
+			vz[i] += hdt * az[i];
+			rx[i] += deltaT * vx[i];
+			ry[i] += deltaT * vy[i];
+			rz[i] += deltaT * vz[i];
+			double dx = rx[i] - nebrRx[i], dy = ry[i] - nebrRy[i], dz = rz[i] - nebrRz[i];
+			dx -= region.x * ((dx >= hx) - (dx < -hx));
+			dy -= region.y * ((dy >= hy) - (dy < -hy));
+			dz -= region.z * ((dz >= hz) - (dz < -hz));
+			ddMax = std::max(ddMax, dx*dx + dy*dy + dz*dz);
+			if (wrap) {
+				wrapCoord(rx[i], imx[i], region.x);
+				wrapCoord(ry[i], imy[i], region.y);
+				wrapCoord(rz[i], imz[i], region.z);
+			}
+		}
+		// two atoms that each moved half the skin may have closed the gap
+		reduceAll(&ddMax, 1, COMM_MAX);
+		if (2.0 * std::sqrt(ddMax) > rNebrShell) {
+			nebrNow = 1;
+		}
+	} else {
+		if (nRespa > 1 && stepCount % nRespa == 0) {
+			for (int i = 0; i < nLocal; i++) {
+				vx[i] += hdtLong * alx[i];
+				vy[i] += hdtLong * aly[i];
+				vz[i] += hdtLong * alz[i];
+			}
+		}
+		std::fill(propThr, propThr + 8 * nThreads, 0.0);
+		kickAtoms(0, nLocal, hdt, propThr);
+	}
+}
+
+// second half-kick of atoms lo..hi-1; their momentum, v^2 and m v^2 are
+// added to s[0..4]
+void Sim::kickAtoms(int lo, int hi, double hdt, double *s) {
+	double *__restrict vx = mol.vx, *__restrict vy = mol.vy, *__restrict vz = mol.vz;
+	const double *__restrict ax = mol.ax, *__restrict ay = mol.ay, *__restrict az = mol.az;
+	const double *mass = mol.mass;
+	double px = s[0], py = s[1], pz = s[2], v2sum = s[3], mv2sum = s[4];
+
+	for (int i = lo; i < hi; i++) {
+		vx[i] += hdt * ax[i];
+		vy[i] += hdt * ay[i];
+		vz[i] += hdt * az[i];
+		px += mass[i] * vx[i];
+		py += mass[i] * vy[i];
+		pz += mass[i] * vz[i];
+		double v2 = vx[i]*vx[i] + vy[i]*vy[i] + vz[i]*vz[i];
+		v2sum += v2;
+		mv2sum += mass[i] * v2;
+	}
+	s[0] = px;
+	s[1] = py;
+	s[2] = pz;
+	s[3] = v2sum;
+	s[4] = mv2sum;
+}
+
+// wraps positions into the box and counts the images each atom crosses
+void Sim::wrapPositions() {
+	double *__restrict rx = mol.rx, *__restrict ry = mol.ry, *__restrict rz = mol.rz;
+	int *__restrict imx = mol.imx, *__restrict imy = mol.imy, *__restrict imz = mol.imz;
+
+	for (int i = 0; i < nLocal; i++) {
+		wrapCoord(rx[i], imx[i], region.x);
+		wrapCoord(ry[i], imy[i], region.y);
+		wrapCoord(rz[i], imz[i], region.z);
+	}
+}
+
+void Sim::buildNebrList() {
+	vecR invWid;
+	vecR vecOffset[] = {{0,0,0}, {1,0,0}, {1,1,0}, {0,1,0}, {-1,1,0}, {0,0,1}, {1,0,1},
+			{1,1,1}, {0,1,1}, {-1,1,1}, {-1,0,1}, {-1,-1,1}, {0,-1,1}, {1,-1,1}};
+	double rrNebr = Sqr(rCut + rNebrShell);
+	int cx = int(cells.x), cy = int(cells.y);
+
+	vecDiv(invWid, cells, region);
+
+	#pragma omp parallel num_threads(nThreads)
+	{
+		int t = 0;
+#ifdef _OPENMP
+		t = omp_get_thread_num();
+#endif
+		vecR rs, cc, shift, m1v, m2v;
+		double rr, dx, dy, dz;
+		const double *rx = mol.rx, *ry = mol.ry, *rz = mol.rz;
+
+		/*
+		 * CELL SUBDIVISION FOR NEIGHBOR LIST
+		 * counting sort over contiguous atom ranges; atoms of a cell
+		 * are stored in descending index order, as the linked list
+		 * used to visit them
+		 */
+		int *cnt = cellCount + t * nCell;
+		int lo = long(nMol) * t / nThreads, hi = long(nMol) * (t + 1) / nThreads;
+		std::fill(cnt, cnt + nCell, 0);
+		for (int i = lo; i < hi; i++) {
+			vecSet(rs, rx[i], ry[i], rz[i]);
+			vecScaleAdd(rs, rs, 0.5, region);
+			vecMul(cc, rs, invWid);
+			vecFloor(cc);
+			cellOf[i] = vecLinear(cc, cells);
+			cnt[cellOf[i]]++;
+		}
+		#pragma omp barrier
+		#pragma omp single
+		{
+			int pos = 0;
+			for (int c = 0; c < nCell; c++) {
+				cellStart[c] = pos;
+				for (int k = nThreads - 1; k >= 0; k--) {
+					int n = cellCount[k*nCell + c];
+					cellCount[k*nCell + c] = pos;
+					pos += n;
+				}
+			}
+			cellStart[nCell] = pos;
+		}
+		for (int i = hi - 1; i >= lo; i--) {
+			cellAtom[cnt[cellOf[i]]++] = i;
+		}
+		#pragma omp barrier
+
+		// renumber atoms in cell order so neighbors sit close in memory
+		if (sort_atoms) {
+			reorderMol();
+			rx = mol.rx;
+			ry = mol.ry;
+			rz = mol.rz;
+		}
+
+		/*
+		 * NEIGHBOR PAIRS
+		 * half list in CSR form: the neighbors of atom j1 are
+		 * nebrTab[nebrStart[j1]] .. nebrTab[nebrStart[j1+1]-1]; each
+		 * thread collects the lists of a contiguous block of cells
+		 * in its own buffer before they are copied into place
+		 */
+		std::vector<int> &buff = nebrBuff[t];
+		buff.clear();
+		int m2Off[14];
+		vecR shiftOff[14];
+		int c1lo = long(nCell) * t / nThreads, c1hi = long(nCell) * (t + 1) / nThreads;
+		for (int m1 = c1lo; m1 < c1hi; m1++) {
+			vecSet(m1v, m1 % cx, (m1 / cx) % cy, m1 / (cx * cy));
+			for (int Noff = 0; Noff < 14; Noff++) {
+				vecAdd(m2v, m1v, vecOffset[Noff]);
+				vecSet(shiftOff[Noff], 0, 0, 0);
+				cellWrapAll(m2v, shiftOff[Noff], cells, region);
+				m2Off[Noff] = vecLinear(m2v, cells);
+			}
+			for (int p1 = cellStart[m1]; p1 < cellStart[m1+1]; p1++) {
+				int j1 = cellAtom[p1];
+				nebrOff[j1] = buff.size();
+				for (int Noff = 0; Noff < 14; Noff++) {
+					int m2 = m2Off[Noff];
+					shift = shiftOff[Noff];
+					for (int p2 = cellStart[m2]; p2 < cellStart[m2+1]; p2++) {
+						int j2 = cellAtom[p2];
+						if (m1 != m2 || j1 > j2) {
+							dx = rx[j1] - rx[j2] - shift.x;
+							dy = ry[j1] - ry[j2] - shift.y;
+							dz = rz[j1] - rz[j2] - shift.z;
+							rr = dx*dx + dy*dy + dz*dz;
+							if (rr < rrNebr) {
+								buff.push_back(j2);
+							}
+						}
+					}
+				}
+				nebrStart[j1+1] = buff.size() - nebrOff[j1];
+			}
+		}
+
+		// prefix sum over the per-atom counts; grow the table if needed
+		#pragma omp barrier
+		#pragma omp single
+		{
+			nebrStart[0] = 0;
+			for (int i = 0; i < nMol; i++) {
+				nebrStart[i+1] += nebrStart[i];
+			}
+			nebrTabLen = nebrStart[nMol];
+			if (nebrTabLen > nebrTabMax) {
+				growNebrTab();
+			}
+		}
+		for (int m1 = c1lo; m1 < c1hi; m1++) {
+			for (int p1 = cellStart[m1]; p1 < cellStart[m1+1]; p1++) {
+				int j1 = cellAtom[p1];
+				std::copy(buff.begin() + nebrOff[j1],
+					buff.begin() + nebrOff[j1] + (nebrStart[j1+1] - nebrStart[j1]),
+					nebrTab + nebrStart[j1]);
+			}
+		}
+
+		// positions the displacement check in evalProps() refers to
+		#pragma omp for schedule(static)
+		for (int i = 0; i < nMol; i++) {
+			nebrRx[i] = rx[i];
+			nebrRy[i] = ry[i];
+			nebrRz[i] = rz[i];
+		}
+	}
+}
+
+/*
+ * hill climb on the time spent in neighbor builds and forces per step:
+ * every stepNebrAdapt steps the skin moves by 10%, and the direction
+ * flips whenever the last move made the cost worse
+ */
+void Sim::adaptNebrShell(double secs) {
+	nebrWinTime += secs;
+	nebrWinSteps++;
+	if (nebrWinSteps < stepNebrAdapt) {
+		return;
+	}
+
+	double cost = nebrWinTime / nebrWinSteps;
+	if (nebrCostPrev > 0 && cost > nebrCostPrev) {
+		nebrShellDir = -nebrShellDir;
+	}
+	nebrCostPrev = cost;
+	nebrWinTime = 0;
+	nebrWinSteps = 0;
+
+	rNebrShell *= 1.0 + 0.1 * nebrShellDir;
+	rNebrShell = std::min(std::max(rNebrShell, 0.1), rNebrShellMax);
+	nebrNow = 1;
+}
+
+// called by every thread of the team in buildNebrList()
+void Sim::reorderMol() {
+	#pragma omp for schedule(static)
+	for (int k = 0; k < nMol; k++) {
+		int i = cellAtom[k];
+		molTmp.rx[k] = mol.rx[i];
+		molTmp.ry[k] = mol.ry[i];
+		molTmp.rz[k] = mol.rz[i];
+		molTmp.vx[k] = mol.vx[i];
+		molTmp.vy[k] = mol.vy[i];
+		molTmp.vz[k] = mol.vz[i];
+		molTmp.ax[k] = mol.ax[i];
+		molTmp.ay[k] = mol.ay[i];
+		molTmp.az[k] = mol.az[i];
+		molTmp.mass[k] = mol.mass[i];
+		molTmp.type[k] = mol.type[i];
+		molTmp.id[k] = mol.id[i];
+		molTmp.imx[k] = mol.imx[i];
+		molTmp.imy[k] = mol.imy[i];
+		molTmp.imz[k] = mol.imz[i];
+		molSlot[mol.id[i]] = k;
+		cellAtom[k] = k;
+	}
+	#pragma omp single
+	{
+		std::swap(mol, molTmp);
+	}
+}
+
+// with kick, also the second half-kick of the step (see kickAtoms());
+// with inner, only the short range r-RESPA forces over the inner list
+void Sim::computeForces(int kick, int inner) {
+	double *ax = mol.ax, *ay = mol.ay, *az = mol.az;
+	const double *mass = mol.mass;
+	double uS = 0, virS = 0, hdt = 0.5 * deltaT;
+	const int *start = inner ? nebrStartIn : nebrStart;
+	int len = inner ? nebrTabLenIn : nebrTabLen;
+	PairArgs args = {mol.rx, mol.ry, mol.rz, mol.type, start,
+		inner ? nebrTabIn : nebrTab, inner ? ljTabIn.data() : ljTab.data(),
+		nType, region};
+
+	/*
+	 * NEIGHBOR LIST
+	 * each thread takes a block of atoms holding about the same number
+	 * of pairs and scatters pair forces into its own buffer; the
+	 * buffers are summed and divided by the mass afterwards, for the
+	 * ghosts too, whose share then goes back to their own ranks. The
+	 * buffers start out zero and the sum clears what it has read, so
+	 * they are ready for the next call without a pass of their own
+	 */
+	#pragma omp parallel num_threads(nThreads) reduction(+:uS, virS)
+	{
+		int t = 0;
+#ifdef _OPENMP
+		t = omp_get_thread_num();
+#endif
+		double *fx = accBuff + 3 * t * nMolPad;
+		double *fy = fx + nMolPad, *fz = fy + nMolPad;
+
+		int lo = std::lower_bound(start, start + nLocal,
+			long(len) * t / nThreads) - start;
+		int hi = std::lower_bound(start, start + nLocal,
+			long(len) * (t + 1) / nThreads) - start;
+		if (t == nThreads - 1) {
+			hi = nLocal;
+		}
+		pairKernel(args, lo, hi, fx, fy, fz, uS, virS);
+		#pragma omp barrier
+
+		// in blocks small enough that the kick finds them still in cache
+		int n = nLocal + nGhost, hiT = long(n) * (t + 1) / nThreads;
+		double *s = propThr + 8 * t;
+		std::fill(s, s + 8, 0.0);
+		for (int lo = long(n) * t / nThreads; lo < hiT; lo += 256) {
+			int hi = std::min(lo + 256, hiT);
+			for (int i = lo; i < hi; i++) {
+				double sx = 0, sy = 0, sz = 0;
+				for (int k = 0; k < nThreads; k++) {
+					double *bx = accBuff + 3 * k * nMolPad;
+					sx += bx[i];
+					sy += bx[i + nMolPad];
+					sz += bx[i + 2 * nMolPad];
+					bx[i] = bx[i + nMolPad] = bx[i + 2 * nMolPad] = 0;
+				}
+				ax[i] = sx / mass[i];
+				ay[i] = sy / mass[i];
+				az[i] = sz / mass[i];
+			}
+			if (kick) {
+				kickAtoms(lo, hi, hdt, s);
+			}
+		}
+	}
+
+	if (nRank > 1) {
+		perfStart(perfSecs, PERF_COMM);
+		ddHaloReverse();
+		perfStop();
+	}
+
+	// the kernels sum 12 times the pair energy
+	double sums[] = {uS / 12.0, virS};
+	reduceAll(sums, 2, COMM_SUM);
+	uSum = sums[0];
+	virSum = sums[1];
+	pairCount += len;
+}
+
+/*
+ * r-RESPA: the short range forces every step and, at the end of every
+ * nRespa steps, all of them; the difference is the long range part,
+ * kept in alx, aly, alz with its energy and virial in uLong and virLong.
+ * uSum and virSum get the total.
+ */
+void Sim::respaForces(int kick) {
+	int outer = (stepCount % nRespa == 0);
+	if (outer) {
+		computeForces(0, 0);
+		std::copy(mol.ax, mol.ax + nLocal, alx);
+		std::copy(mol.ay, mol.ay + nLocal, aly);
+		std::copy(mol.az, mol.az + nLocal, alz);
+		uLong = uSum;
+		virLong = virSum;
+	}
+	computeForces(kick, 1);
+	if (outer) {
+		for (int i = 0; i < nLocal; i++) {
+			alx[i] -= mol.ax[i];
+			aly[i] -= mol.ay[i];
+			alz[i] -= mol.az[i];
+		}
+		uLong -= uSum;
+		virLong -= virSum;
+	}
+	uSum += uLong;
+	virSum += virLong;
+}
+
+/*
+ * r-RESPA: the pairs of the neighbor list that may come within rRespa
+ * before the next rebuild, in the same CSR form; counted on the first
+ * pass and stored on the second
+ */
+void Sim::buildInnerList() {
+	const double *rx = mol.rx, *ry = mol.ry, *rz = mol.rz;
+	double hx = 0.5 * region.x, hy = 0.5 * region.y, hz = 0.5 * region.z;
+	double rrIn = Sqr(rRespa + rNebrShell);
+
+	#pragma omp parallel num_threads(nThreads)
+	for (int pass = 0; pass < 2; pass++) {
+		#pragma omp for schedule(static)
+		for (int i = 0; i < nLocal; i++) {
+			int m = pass ? nebrStartIn[i] : 0;
+			for (int k = nebrStart[i]; k < nebrStart[i+1]; k++) {
+				int j = nebrTab[k];
+				double dx = rx[i] - rx[j], dy = ry[i] - ry[j], dz = rz[i] - rz[j];
+				dx -= region.x * ((dx >= hx) - (dx < -hx));
+				dy -= region.y * ((dy >= hy) - (dy < -hy));
+				dz -= region.z * ((dz >= hz) - (dz < -hz));
+				if (dx*dx + dy*dy + dz*dz < rrIn) {
+					if (pass) {
+						nebrTabIn[m] = j;
+					}
+					m++;
+				}
+			}
+			if (!pass) {
+				nebrStartIn[i+1] = m;
+			}
+		}
+		#pragma omp single
+		if (!pass) {
+			nebrStartIn[0] = 0;
+			for (int i = 0; i < nLocal; i++) {
+				nebrStartIn[i+1] += nebrStartIn[i];
+			}
+			nebrTabLenIn = nebrStartIn[nLocal];
+		}
+	}
+}
+
+// from the sums kickAtoms() left in propThr, added in thread order
+void Sim::evalProps() {
+	double sums[5] = {0, 0, 0, 0, 0};
+	for (int t = 0; t < nThreads; t++) {
+		for (int k = 0; k < 5; k++) {
+			sums[k] += propThr[8*t + k];
+		}
+	}
+	reduceAll(sums, 5, COMM_SUM);
+	vecSet(momSum, sums[0], sums[1], sums[2]);
+	double v2sum = sums[3];
+	mv2Sum = sums[4];
+
+	kinEnergy.val = 0.5 * v2sum / nMol;
+	totEnergy.val = kinEnergy.val + uSum / nMol;
+	pressure.val = density * (v2sum + virSum) / (nMol * nDim);
+}
+
+void Sim::printSummary() {
+	perfStart(perfSecs, PERF_OUTPUT);
+	OutFrame *f = asyncOutAcquire(*asyncOut);
+	f->kind = OUT_SUMMARY;
+	f->step = stepCount;
+	f->data[0] = timeNow;
+	f->data[1] = std::sqrt(vecLenSq(momSum))/nMol;
+	f->data[2] = kinEnergy.sum;
+	f->data[3] = totEnergy.sum;
+	f->data[4] = pressure.sum;
+	f->data[5] = latticeCorr;
+	asyncOutPublish(*asyncOut);
+	perfStop();
+}
+
+void Sim::posDump() {
+	perfStart(perfSecs, PERF_DUMP);
+	if (rank > 0) {
+		ddGather(nullptr, nullptr, nullptr);
+		perfStop();
+		return;
+	}
+	OutFrame *f = asyncOutAcquire(*asyncOut);
+	double *x = f->data, *y = f->data + nMol, *z = f->data + 2*nMol;
+	if (nRank > 1) {
+		ddGather(x, y, z);
+	} else {
+		for (int n = 0; n < nMol; n++) {
+			int i = molSlot[n];
+			x[n] = mol.rx[i];
+			y[n] = mol.ry[i];
+			z[n] = mol.rz[i];
+		}
+	}
+	f->kind = OUT_DUMP;
+	f->time = timeNow;
+	f->region = region;
+	asyncOutPublish(*asyncOut);
+	perfStop();
+}
+
+// runs on the output thread when there is one
+void Sim::writeFrame(OutFrame &f) {
+	perfStart(perfSecs, (f.kind == OUT_DUMP) ? PERF_WRITE_DUMP : PERF_WRITE_TEXT);
+	if (f.kind == OUT_DUMP) {
+		double *x = f.data, *y = f.data + nMol, *z = f.data + 2*nMol;
+		if (trajInfo.mode != TRAJ_TEXT) {
+			trajWriteFrame(dumpFile, trajInfo, f.time, f.region, x, y, z);
+			perfStop();
+			return;
+		}
+		dumpFile << "ITEM: TIMESTEP\n" << f.time << '\n'
+			<< "ITEM: NUMBER OF ATOMS\n" << nMol << '\n'
+			<< "ITEM: BOX BOUNDS pp pp pp\n"
+			<< -0.5*f.region.x << ' ' << 0.5*f.region.x << '\n'
+			<< -0.5*f.region.y << ' ' << 0.5*f.region.y << '\n'
+			<< -0.5*f.region.z << ' ' << 0.5*f.region.z << '\n'
+			<< "ITEM: ATOMS id type x y z\n";
+		for (int n = 0; n < nMol; n++) {
+			dumpFile << n+1 << ' ' << trajInfo.type[n] << ' '
+				<< x[n] << ' ' << y[n] << ' ' << z[n] << '\n';
+		}
+	} else if (f.kind == OUT_SUMMARY) {
+		outFile << f.step;
+		for (int k = 0; k < 6; k++) {
+			outFile << '\t' << f.data[k];
+		}
+		outFile << '\n';
+	} else if (f.kind == OUT_TABLE) {
+		*f.file << f.head;
+		for (int n = 0; n < f.nRow; n++) {
+			const double *row = f.data + n * f.nCol;
+			*f.file << row[0];
+			for (int k = 1; k < f.nCol; k++) {
+				*f.file << '\t' << row[k];
+			}
+			*f.file << '\n';
+		}
+		*f.file << f.tail;
+	} else if (f.kind == OUT_FLUSH) {
+		outFile.flush();
+		dumpFile.flush();
+		rdfFile.flush();
+		msdFile.flush();
+		dfsFile.flush();
+		acfFile.flush();
+	}
+	perfStop();
+}
+
+/*
+ * time per phase over the steps of this run, in seconds, percent of the
+ * stepping time and microseconds per step; with an output thread the
+ * write phases overlap the others and are left out of "other"
+ */
+void Sim::printPerf() {
+	double nStep = std::max(nStepRun, 1);
+	double secsIn = 0;
+	outFile << "Phase\tseconds\t%\tus/step\n";
+	for (int p = 0; p <= N_PERF; p++) {
+		double secs = (p < N_PERF) ? perfSecs[p] : secsRun - secsIn;
+		if (p < N_PERF && (nOutSlot == 0 || p < PERF_WRITE_DUMP)) {
+			secsIn += secs;
+		}
+		outFile << ((p < N_PERF) ? perfName(p) : "other") << '\t' << secs << '\t'
+			<< 100 * secs / secsRun << '\t' << 1e6 * secs / nStep << '\n';
+	}
+	outFile << "Listed pairs per step: " << pairCount / nStep << ", force time per pair: "
+		<< 1e9 * perfSecs[PERF_FORCE] / std::max(pairCount, 1.0) << " ns\n";
+	outFile << "Atom steps per second: " << nMol * nStep / secsRun << '\n';
+}
+
+void Sim::evalRdf() {
+	double deltaR = rangeRdf / sizeHistRdf;
+	int nHist = nPairRdf * sizeHistRdf;
+
+	if (countRdf == 0) {
+		std::fill(histRdf, histRdf + nHist, 0);
+	}
+
+	/*
+	 * within the cutoff the neighbor list already holds every pair;
+	 * beyond it atoms are sorted into cells at least rangeRdf wide and
+	 * each atom meets the lower numbered atoms of the cells around it;
+	 * with fewer than three cells on a side several offsets wrap to the
+	 * same cell, which is then visited only once
+	 */
+	int useList = neigh_list && rangeRdf <= rCut;
+	if (!useList && nRank > 1) {
+		ddBinCells(rHalo);
+	} else if (!useList) {
+		vecR rs, cc, invWid;
+		vecDiv(invWid, cellsRdf, region);
+		std::fill(rdfCellStart, rdfCellStart + nCellRdf + 1, 0);
+		for (int n = 0; n < nMol; n++) {
+			vecSet(rs, mol.rx[n], mol.ry[n], mol.rz[n]);
+			vecScaleAdd(rs, rs, 0.5, region);
+			vecMul(cc, rs, invWid);
+			vecFloor(cc);
+			vecSet(cc, std::min(cc.x, cellsRdf.x - 1), std::min(cc.y, cellsRdf.y - 1),
+				std::min(cc.z, cellsRdf.z - 1));
+			rdfCellOf[n] = vecLinear(cc, cellsRdf);
+			rdfCellStart[rdfCellOf[n] + 1]++;
+		}
+		for (int c = 0; c < nCellRdf; c++) {
+			rdfCellStart[c+1] += rdfCellStart[c];
+		}
+		for (int n = 0; n < nMol; n++) {
+			rdfCellAtom[rdfCellStart[rdfCellOf[n]]++] = n;
+		}
+		for (int c = nCellRdf; c > 0; c--) {
+			rdfCellStart[c] = rdfCellStart[c-1];
+		}
+		rdfCellStart[0] = 0;
+	}
+
+	// each thread bins into its own histograms, summed at the end
+	#pragma omp parallel num_threads(nThreads)
+	{
+		int t = 0;
+#ifdef _OPENMP
+		t = omp_get_thread_num();
+#endif
+		double *hist = histRdfThr + t * sizeHistRdfPad;
+		std::fill(hist, hist + nHist, 0);
+
+		if (useList) {
+			#pragma omp for schedule(dynamic, 64)
+			for (int j1 = 0; j1 < nLocal; j1++) {
+				for (int p = nebrStart[j1]; p < nebrStart[j1+1]; p++) {
+					rdfPair(hist, j1, nebrTab[p], deltaR);
+				}
+			}
+		} else if (nRank > 1) {
+			ddRdfPairs(hist, deltaR);
+		} else {
+			vecR m2v;
+			int cx = int(cellsRdf.x), cy = int(cellsRdf.y);
+			#pragma omp for schedule(dynamic)
+			for (int m1 = 0; m1 < nCellRdf; m1++) {
+				int m2Nebr[27], nNebr = 0;
+				for (int k = 0; k < 27; k++) {
+					vecSet(m2v, m1 % cx + k % 3 - 1, (m1 / cx) % cy + (k / 3) % 3 - 1,
+						m1 / (cx * cy) + k / 9 - 1);
+					vecSet(m2v, (m2v.x < 0) ? cellsRdf.x - 1 : (m2v.x >= cellsRdf.x) ? 0 : m2v.x,
+						(m2v.y < 0) ? cellsRdf.y - 1 : (m2v.y >= cellsRdf.y) ? 0 : m2v.y,
+						(m2v.z < 0) ? cellsRdf.z - 1 : (m2v.z >= cellsRdf.z) ? 0 : m2v.z);
+					int m2 = vecLinear(m2v, cellsRdf);
+					if (std::find(m2Nebr, m2Nebr + nNebr, m2) == m2Nebr + nNebr) {
+						m2Nebr[nNebr++] = m2;
+					}
+				}
+				for (int p1 = rdfCellStart[m1]; p1 < rdfCellStart[m1+1]; p1++) {
+					int j1 = rdfCellAtom[p1];
+					for (int k = 0; k < nNebr; k++) {
+						int m2 = m2Nebr[k];
+						for (int p2 = rdfCellStart[m2]; p2 < rdfCellStart[m2+1]; p2++) {
+							int j2 = rdfCellAtom[p2];
+							if (j2 < j1) {
+								rdfPair(hist, j1, j2, deltaR);
+							}
+						}
+					}
+				}
+			}
+		}
+
+		#pragma omp for schedule(static)
+		for (int n = 0; n < nHist; n++) {
+			double sum = 0;
+			for (int k = 0; k < nThreads; k++) {
+				sum += histRdfThr[k * sizeHistRdfPad + n];
+			}
+			histRdf[n] += sum;
+		}
+	}
+
+	countRdf++;
+	if (countRdf == limitRdf) {
+		std::vector<double> nOfType(nType, 0);
+		for (int n = 0; n < nLocal; n++) {
+			nOfType[mol.type[n] - 1]++;
+		}
+		reduceAll(nOfType.data(), nType, COMM_SUM);
+		reduceAll(histRdf, nHist, COMM_SUM);
+		for (int t1 = 0; t1 < nType; t1++) {
+			for (int t2 = t1; t2 < nType; t2++) {
+				double normFac;
+				if (t1 == t2) {
+					normFac = vecProd(region)
+						/ (2.0 * 3.141592654 * Cub(deltaR) * Sqr(nOfType[t1]) * countRdf);
+				} else {
+					normFac = vecProd(region)
+						/ (4.0 * 3.141592654 * Cub(deltaR) * (nOfType[t1]*nOfType[t2]) * countRdf);
+				}
+				double *h = histRdf + rdfPairCol[t1*nType + t2] * sizeHistRdf;
+				for (int n = 0; n < sizeHistRdf; n++) {
+					h[n] *= normFac / Sqr(n + 0.5);
+				}
+			}
+		}
+		printRdf();
+		countRdf = 0;
+	}
+}
+
+// bins one pair by its minimum image distance
+void Sim::rdfPair(double *hist, int j1, int j2, double deltaR) {
+	vecR dr;
+	vecSet(dr, mol.rx[j2] - mol.rx[j1], mol.ry[j2] - mol.ry[j1],
+		mol.rz[j2] - mol.rz[j1]);
+	vecWrapAll(dr, region);
+	double rr = vecLenSq(dr);
+	if (rr < Sqr(rangeRdf)) {
+		int n = std::sqrt(rr) / deltaR;
+		int col = rdfPairCol[(mol.type[j1] - 1) * nType + mol.type[j2] - 1];
+		hist[col * sizeHistRdf + n]++;
+	}
+}
+
+void Sim::printRdf() {
+	perfStart(perfSecs, PERF_OUTPUT);
+	OutFrame *f = asyncOutAcquire(*asyncOut);
+	int nCol = 1 + nPairRdf;
+	for (int n = 0; n < sizeHistRdf; n++) {
+		double *row = f->data + nCol * n;
+		row[0] = (n + 0.5) * rangeRdf / sizeHistRdf;
+		for (int k = 0; k < nPairRdf; k++) {
+			row[1+k] = histRdf[k * sizeHistRdf + n];
+		}
+	}
+	std::string head = "RDF";
+	for (int t = 0; t < nType; t++) {
+		head += std::string(" ") + char('A' + t) + char('A' + t);
+	}
+	for (int t1 = 0; t1 < nType; t1++) {
+		for (int t2 = t1 + 1; t2 < nType; t2++) {
+			head += std::string(" ") + char('A' + t1) + char('A' + t2);
+		}
+	}
+	f->kind = OUT_TABLE;
+	f->file = &rdfFile;
+	f->nRow = sizeHistRdf;
+	f->nCol = nCol;
+	f->head = head + "\n";
+	f->tail = "";
+	asyncOutPublish(*asyncOut);
+	perfStop();
+}
+
+void Sim::evalLatticeCorr() {
+	vecR kVec;
+	double si = 0, sr = 0, t;
+
+	kVec.x = 2.0 * 3.141592654 * initUcell.x / region.x;
+	kVec.y = - kVec.x;
+	kVec.z = kVec.x;
+
+	for (int n = 0; n < nLocal; n++) {
+		t = kVec.x * mol.rx[n] + kVec.y * mol.ry[n] + kVec.z * mol.rz[n];
+		sr += std::cos(t);
+		si += std::sin(t);
+	}
+	double sums[] = {sr, si};
+	reduceAll(sums, 2, COMM_SUM);
+	sr = sums[0];
+	si = sums[1];
+
+	latticeCorr = std::sqrt(Sqr(sr) + Sqr(si)) / nMol;
+}
+
+void Sim::initDiffusion() {
+	for (int nb = 0; nb < nBuffDiff; nb++) {
+		bufferAA[nb].count = -nb * nValDiff / nBuffDiff;
+		bufferBB[nb].count = -nb * nValDiff / nBuffDiff;
+		bufferAB[nb].count = -nb * nValDiff / nBuffDiff;
+	}
+	zeroDiffusion();
+}
+
+void Sim::zeroDiffusion() {
+	countDiffAvg = 0;
+	for (int j = 0; j < nValDiff; j++) {
+		rrDiffAvgAA[j] = 0;
+		rrDiffAvgBB[j] = 0;
+		rrDiffAvgAB[j] = 0;
+	}
+}
+
+/*
+ * displacements from each origin come from the image counters kept by
+ * wrapPositions(): r + (im - im0) * region - r0; the sums of all buffers
+ * are reduced over the ranks at once
+ */
+void Sim::evalDiffusion() {
+	vecR dr, r, rSum;
+	std::vector<double> sums(5 * nBuffDiff, 0.0);
+	for (int nb = 0; nb < nBuffDiff; nb++) {
+		if (bufferAA[nb].count == 0) {
+			for (int n = 0; n < nLocal; n++) {
+				Tbuff &b = (mol.type[n] == 1) ? bufferAA[nb] : bufferBB[nb];
+				int k = typeIdx[mol.id[n]];
+				vecSet(b.orgR[k], mol.rx[n], mol.ry[n], mol.rz[n]);
+				b.orgIm[k] = {mol.imx[n], mol.imy[n], mol.imz[n]};
+			}
+		}
+		if (bufferAA[nb].count >= 0) {
+			vecSet(rSum, 0, 0, 0);
+			double rrA = 0, rrB = 0;
+			for (int n = 0; n < nLocal; n++) {
+				Tbuff &b = (mol.type[n] == 1) ? bufferAA[nb] : bufferBB[nb];
+				int k = typeIdx[mol.id[n]];
+				vecI im0 = b.orgIm[k];
+				vecSet(r, mol.rx[n] + (mol.imx[n] - im0.x) * region.x,
+					mol.ry[n] + (mol.imy[n] - im0.y) * region.y,
+					mol.rz[n] + (mol.imz[n] - im0.z) * region.z);
+				vecSub(dr, r, b.orgR[k]);
+				if (mol.type[n] == 1) {
+					rrA += vecLenSq(dr);
+					vecAdd(rSum, rSum, dr);
+				} else {
+					rrB += vecLenSq(dr);
+				}
+			}
+			double *sb = &sums[5 * nb];
+			sb[0] = rrA;
+			sb[1] = rrB;
+			sb[2] = rSum.x;
+			sb[3] = rSum.y;
+			sb[4] = rSum.z;
+		}
+	}
+	reduceAll(sums.data(), 5 * nBuffDiff, COMM_SUM);
+	for (int nb = 0; nb < nBuffDiff; nb++) {
+		if (bufferAA[nb].count >= 0) {
+			int ni = bufferAA[nb].count;
+			const double *sb = &sums[5 * nb];
+			vecSet(rSum, sb[2], sb[3], sb[4]);
+			bufferAA[nb].rrDiff[ni] = sb[0];
+			bufferBB[nb].rrDiff[ni] = sb[1];
+			bufferAB[nb].rrDiff[ni] = vecLenSq(rSum);
+		}
+		bufferAA[nb].count++;
+	}
+
+	accumDiffusion();
+}
+
+void Sim::accumDiffusion() {
+	for (int nb = 0; nb < nBuffDiff; nb++) {
+		if (bufferAA[nb].count == nValDiff) {
+			for (int j = 0; j < nValDiff; j++) {
+				rrDiffAvgAA[j] += bufferAA[nb].rrDiff[j];
+				rrDiffAvgBB[j] += bufferBB[nb].rrDiff[j];
+				rrDiffAvgAB[j] += bufferAB[nb].rrDiff[j];
+			}
+			bufferAA[nb].count = 0;
+			countDiffAvg++;
+			if (countDiffAvg == limitDiffAvg) {
+				reportDiffusion(limitDiffAvg);
+				zeroDiffusion();
+			}
+		}
+	}
+}
+
+// rrDiffAvg* hold squared displacements summed over nAvg time origins
+void Sim::reportDiffusion(double nAvg) {
+	double facAA, facBB, facAB;
+	printMsd(nAvg);
+	facAA = 1.0 / (nDim * 2 * nMolA * stepDiff * deltaT * nAvg);
+	facBB = 1.0 / (nDim * 2 * nMolB * stepDiff * deltaT * nAvg);
+	facAB = Q / (nDim * 2 * nMol * stepDiff * deltaT * nAvg);
+	for (int k = 1; k < nValDiff; k++) {
+		rrDiffAvgAA[k] *= facAA / k;
+		rrDiffAvgBB[k] *= facBB / k;
+		rrDiffAvgAB[k] *= facAB / k;
+	}
+	printDiffusion();
+}
+
+void Sim::printMsd(double nAvg) {
+	perfStart(perfSecs, PERF_OUTPUT);
+	OutFrame *f = asyncOutAcquire(*asyncOut);
+	for (int j = 0; j < nValDiff; j++) {
+		double *row = f->data + 4 * j;
+		row[0] = j * stepDiff * deltaT;
+		row[1] = rrDiffAvgAA[j] / nAvg / nMolA;
+		row[2] = rrDiffAvgBB[j] / nAvg / nMolB;
+		row[3] = rrDiffAvgAB[j] / nAvg / nMol;
+	}
+	f->kind = OUT_TABLE;
+	f->file = &msdFile;
+	f->nRow = nValDiff;
+	f->nCol = 4;
+	f->head = "MSD AA BB AB\n";
+	f->tail = "";
+	asyncOutPublish(*asyncOut);
+	perfStop();
+}
+
+void Sim::printDiffusion() {
+	perfStart(perfSecs, PERF_OUTPUT);
+	OutFrame *f = asyncOutAcquire(*asyncOut);
+	for (int j = 0; j < nValDiff; j++) {
+		double *row = f->data + 4 * j;
+		row[0] = j * stepDiff * deltaT;
+		row[1] = rrDiffAvgAA[j];
+		row[2] = rrDiffAvgBB[j];
+		row[3] = rrDiffAvgAB[j];
+	}
+	f->kind = OUT_TABLE;
+	f->file = &dfsFile;
+	f->nRow = nValDiff;
+	f->nCol = 4;
+	f->head = "Diffusion AA BB AB\n";
+	f->tail = "";
+	asyncOutPublish(*asyncOut);
+	perfStop();
+}
+
+void Sim::initVacf() {
+	for (int nb = 0; nb < nBuffAcf; nb++) {
+		vacBuff[nb].count = -nb * nValAcf / nBuffAcf;
+	}
+	zeroVacf();
+}
+
+void Sim::zeroVacf() {
+	countAcfAvg = 0;
+	for (int j = 0; j < nValAcf; j++) {
+		avgAcfVel[j] = 0;
+	}
+}
+
+void Sim::evalVacf() {
+	std::vector<double> sums(nBuffAcf, 0.0);
+	for (int nb = 0; nb < nBuffAcf; nb++) {
+		if (vacBuff[nb].count == 0) {
+			for (int n = 0; n < nLocal; n++) {
+				vecSet(vacBuff[nb].orgVel[mol.id[n]], mol.vx[n], mol.vy[n], mol.vz[n]);
+			}
+		}
+		if (vacBuff[nb].count >= 0) {
+			vecR *orgVel = vacBuff[nb].orgVel;
+			double acf = 0;
+			for (int n = 0; n < nLocal; n++) {
+				int id = mol.id[n];
+				acf += orgVel[id].x * mol.vx[n] + orgVel[id].y * mol.vy[n]
+					+ orgVel[id].z * mol.vz[n];
+			}
+			sums[nb] = acf;
+		}
+	}
+	reduceAll(sums.data(), nBuffAcf, COMM_SUM);
+	for (int nb = 0; nb < nBuffAcf; nb++) {
+		if (vacBuff[nb].count >= 0) {
+			vacBuff[nb].acfVel[vacBuff[nb].count] = sums[nb];
+		}
+		vacBuff[nb].count++;
+	}
+
+	accumVacf();
+}
+
+void Sim::accumVacf() {
+	for (int nb = 0; nb < nBuffAcf; nb++) {
+		if (vacBuff[nb].count == nValAcf) {
+			for (int j = 0; j < nValAcf; j++) {
+				avgAcfVel[j] += vacBuff[nb].acfVel[j];
+			}
+			vacBuff[nb].count = 0;
+			countAcfAvg++;
+			if (countAcfAvg == limitAcfAvg) {
+				reportVacf(limitAcfAvg);
+				zeroVacf();
+			}
+		}
+	}
+}
+
+double integrate(double *f, int nf) {
+	double s = 0.5 * (f[0] + f[nf-1]);
+	for (int i = 1; i < nf-1; i++) {
+		s += f[i];
+	}
+	return s;
+}
+
+// avgAcfVel holds velocity products summed over nAvg time origins
+void Sim::reportVacf(double nAvg) {
+	double fac = stepAcf * deltaT / (nDim * nMol * nAvg);
+	intAcfVel = fac * integrate(avgAcfVel, nValAcf);
+	for (int k = 1; k < nValAcf; k++) {
+		avgAcfVel[k] /= avgAcfVel[0];
+	}
+	avgAcfVel[0] = 1;
+	printVacf();
+}
+
+void Sim::printVacf() {
+	perfStart(perfSecs, PERF_OUTPUT);
+	OutFrame *f = asyncOutAcquire(*asyncOut);
+	for (int j = 0; j < nValAcf; j++) {
+		f->data[2*j] = j * stepAcf * deltaT;
+		f->data[2*j+1] = avgAcfVel[j];
+	}
+	f->kind = OUT_TABLE;
+	f->file = &acfFile;
+	f->nRow = nValAcf;
+	f->nCol = 2;
+	f->head = "VACF\n";
+	std::ostringstream tail;
+	tail << "VACF integral: " << intAcfVel << '\n';
+	f->tail = tail.str();
+	asyncOutPublish(*asyncOut);
+	perfStop();
+}
+
+// unwrapped positions by id for the correlators, from the image counters
+void Sim::unwrapPositions() {
+	for (int n = 0; n < nMol; n++) {
+		vecSet(corrRUnw[mol.id[n]], mol.rx[n] + mol.imx[n] * region.x,
+			mol.ry[n] + mol.imy[n] * region.y, mol.rz[n] + mol.imz[n] * region.z);
+	}
+}
+
+// one sample of the FFT correlator
+void Sim::evalCorrFft() {
+	int t = countCorr;
+	unwrapPositions();
+	for (int n = 0; n < nMol; n++) {
+		int id = mol.id[n];
+		double *p = corrPos + 3L * id * nCorr, *v = corrVel + 3L * id * nCorr;
+		p[t] = corrRUnw[id].x;
+		p[nCorr + t] = corrRUnw[id].y;
+		p[2*nCorr + t] = corrRUnw[id].z;
+		v[t] = mol.vx[n];
+		v[nCorr + t] = mol.vy[n];
+		v[2*nCorr + t] = mol.vz[n];
+	}
+
+	countCorr++;
+	if (countCorr == nCorr) {
+		computeCorrFft();
+		countCorr = 0;
+	}
+}
+
+/*
+ * MSD per species, the interdiffusion term from the summed displacement
+ * of species A and the VACF, each averaged over all nCorr - lag origins
+ * of the block; reported as a single average over one origin
+ */
+void Sim::computeCorrFft() {
+	zeroDiffusion();
+	zeroVacf();
+
+	#pragma omp parallel num_threads(nThreads)
+	{
+		std::vector<double> msdA(nValDiff, 0), msdB(nValDiff, 0), acf(nValAcf, 0);
+		#pragma omp for schedule(static)
+		for (int id = 0; id < nMol; id++) {
+			double *msd = (mol.type[molSlot[id]] == 1) ? msdA.data() : msdB.data();
+			for (int k = 0; k < 3; k++) {
+				accumMsd(corrPos + (3L * id + k) * nCorr, nCorr, nValDiff, msd);
+				accumAutoCorr(corrVel + (3L * id + k) * nCorr, nCorr, nValAcf, acf.data());
+			}
+		}
+		// summed in thread order, so the result does not vary between runs
+		#pragma omp for ordered schedule(static, 1)
+		for (int k = 0; k < nThreads; k++) {
+			#pragma omp ordered
+			{
+				for (int j = 0; j < nValDiff; j++) {
+					rrDiffAvgAA[j] += msdA[j];
+					rrDiffAvgBB[j] += msdB[j];
+				}
+				for (int j = 0; j < nValAcf; j++) {
+					avgAcfVel[j] += acf[j];
+				}
+			}
+		}
+	}
+
+	std::vector<double> sumA(nCorr, 0);
+	for (int k = 0; k < 3; k++) {
+		std::fill(sumA.begin(), sumA.end(), 0);
+		for (int id = 0; id < nMol; id++) {
+			if (mol.type[molSlot[id]] == 1) {
+				const double *p = corrPos + (3L * id + k) * nCorr;
+				for (int t = 0; t < nCorr; t++) {
+					sumA[t] += p[t];
+				}
+			}
+		}
+		accumMsd(sumA.data(), nCorr, nValDiff, rrDiffAvgAB);
+	}
+
+	reportDiffusion(1);
+	reportVacf(1);
+}
+
+void Sim::initMultiTau() {
+	countTau = 0;
+	std::fill(tauMsd, tauMsd + 3 * pTau * nLevTau, 0);
+	std::fill(tauAcf, tauAcf + pTau * nLevTau, 0);
+	std::fill(tauCount, tauCount + pTau * nLevTau, 0);
+	std::fill(tauVelAcc, tauVelAcc + 3L * nMol * (nLevTau + 1), 0);
+	for (int l = 0; l < nLevTau; l++) {
+		tauFill[l] = 0;
+		tauHead[l] = 0;
+		tauAccN[l] = 0;
+	}
+}
+
+/*
+ * one sample of the multiple-tau correlator: rows of tauPosNow are the
+ * unwrapped positions by id and the summed positions of species A, and
+ * the velocities go in as the level -1 accumulator tauVelAcc[0..3*nMol)
+ */
+void Sim::evalMultiTau() {
+	unwrapPositions();
+	double *rA = tauPosNow + 3L * nMol;
+	rA[0] = rA[1] = rA[2] = 0;
+	for (int n = 0; n < nMol; n++) {
+		int id = mol.id[n];
+		double *r = tauPosNow + 3L * id, *v = tauVelAcc + 3L * id;
+		r[0] = corrRUnw[id].x;
+		r[1] = corrRUnw[id].y;
+		r[2] = corrRUnw[id].z;
+		v[0] = mol.vx[n];
+		v[1] = mol.vy[n];
+		v[2] = mol.vz[n];
+		if (mol.type[n] == 1) {
+			rA[0] += r[0];
+			rA[1] += r[1];
+			rA[2] += r[2];
+		}
+	}
+	countTau++;
+	pushMultiTau(0);
+}
+
+/*
+ * Level l keeps its last pTau samples and correlates each new one with
+ * them: lags j * mTau^l, where the lower half of j on levels above 0 is
+ * already covered by the level below. Every mTau samples the current
+ * positions and the mean velocity since the last push move up a level,
+ * so MSD is exact at every lag and the VACF is block averaged.
+ */
+void Sim::pushMultiTau(int l) {
+	int head = (tauHead[l] + 1) % pTau;
+	long sizeP = 3L * nRowTau, sizeV = 3L * nMol;
+	double *velIn = tauVelAcc + l * sizeV;
+	double scale = (l == 0) ? 1.0 : 1.0 / mTau;
+	double *pos = tauPos + (long(l) * pTau + head) * sizeP;
+	double *vel = tauVel + (long(l) * pTau + head) * sizeV;
+	std::copy(tauPosNow, tauPosNow + sizeP, pos);
+	for (long k = 0; k < sizeV; k++) {
+		vel[k] = velIn[k] * scale;
+		velIn[k] = 0;
+	}
+	tauHead[l] = head;
+	tauFill[l] = std::min(tauFill[l] + 1, pTau);
+
+	for (int j = (l == 0) ? 0 : pTau / mTau; j < tauFill[l]; j++) {
+		int s = (head - j + pTau) % pTau;
+		const double *pos0 = tauPos + (long(l) * pTau + s) * sizeP;
+		const double *vel0 = tauVel + (long(l) * pTau + s) * sizeV;
+		double msdA = 0, msdB = 0, acf = 0;
+		for (int id = 0; id < nMol; id++) {
+			double dx = pos[3*id] - pos0[3*id], dy = pos[3*id+1] - pos0[3*id+1],
+				dz = pos[3*id+2] - pos0[3*id+2];
+			double rr = dx*dx + dy*dy + dz*dz;
+			if (mol.type[molSlot[id]] == 1) {
+				msdA += rr;
+			} else {
+				msdB += rr;
+			}
+			acf += vel[3*id] * vel0[3*id] + vel[3*id+1] * vel0[3*id+1]
+				+ vel[3*id+2] * vel0[3*id+2];
+		}
+		double dx = pos[3*nMol] - pos0[3*nMol], dy = pos[3*nMol+1] - pos0[3*nMol+1],
+			dz = pos[3*nMol+2] - pos0[3*nMol+2];
+		int k = l * pTau + j;
+		tauMsd[3*k] += msdA;
+		tauMsd[3*k+1] += msdB;
+		tauMsd[3*k+2] += dx*dx + dy*dy + dz*dz;
+		tauAcf[k] += acf;
+		tauCount[k]++;
+	}
+
+	if (l + 1 < nLevTau) {
+		double *velUp = tauVelAcc + (l + 1) * sizeV;
+		for (long k = 0; k < sizeV; k++) {
+			velUp[k] += vel[k];
+		}
+		if (++tauAccN[l] == mTau) {
+			tauAccN[l] = 0;
+			pushMultiTau(l + 1);
+		}
+	}
+}
+
+// MSD, diffusion and VACF at every lag that has been sampled, in order
+void Sim::reportMultiTau() {
+	std::vector<double> tVal, msdA, msdB, msdAB, acf;
+	for (int l = 0; l < nLevTau; l++) {
+		for (int j = (l == 0) ? 0 : pTau / mTau; j < pTau; j++) {
+			int k = l * pTau + j;
+			if (tauCount[k] == 0) {
+				continue;
+			}
+			tVal.push_back(j * std::pow(mTau, l) * stepDiff * deltaT);
+			msdA.push_back(tauMsd[3*k] / tauCount[k] / nMolA);
+			msdB.push_back(tauMsd[3*k+1] / tauCount[k] / nMolB);
+			msdAB.push_back(tauMsd[3*k+2] / tauCount[k] / nMol);
+			acf.push_back(tauAcf[k] / tauCount[k] / nMol);
+		}
+	}
+	int nRow = tVal.size();
+	if (nRow == 0) {
+		return;
+	}
+
+	OutFrame *f = asyncOutAcquire(*asyncOut);
+	for (int j = 0; j < nRow; j++) {
+		double *row = f->data + 4 * j;
+		row[0] = tVal[j];
+		row[1] = msdA[j];
+		row[2] = msdB[j];
+		row[3] = msdAB[j];
+	}
+	f->kind = OUT_TABLE;
+	f->file = &msdFile;
+	f->nRow = nRow;
+	f->nCol = 4;
+	f->head = "MSD AA BB AB\n";
+	f->tail = "";
+	asyncOutPublish(*asyncOut);
+
+	f = asyncOutAcquire(*asyncOut);
+	for (int j = 0; j < nRow; j++) {
+		double *row = f->data + 4 * j;
+		double fac = (j == 0) ? 0 : 1.0 / (nDim * 2 * tVal[j]);
+		row[0] = tVal[j];
+		row[1] = msdA[j] * fac;
+		row[2] = msdB[j] * fac;
+		row[3] = msdAB[j] * fac * Q;
+	}
+	f->kind = OUT_TABLE;
+	f->file = &dfsFile;
+	f->nRow = nRow;
+	f->nCol = 4;
+	f->head = "Diffusion AA BB AB\n";
+	f->tail = "";
+	asyncOutPublish(*asyncOut);
+
+	// trapezoidal integral over the uneven lags before normalising
+	intAcfVel = 0;
+	for (int j = 1; j < nRow; j++) {
+		intAcfVel += 0.5 * (acf[j] + acf[j-1]) * (tVal[j] - tVal[j-1]) / nDim;
+	}
+	f = asyncOutAcquire(*asyncOut);
+	for (int j = 0; j < nRow; j++) {
+		f->data[2*j] = tVal[j];
+		f->data[2*j+1] = acf[j] / acf[0];
+	}
+	f->kind = OUT_TABLE;
+	f->file = &acfFile;
+	f->nRow = nRow;
+	f->nCol = 2;
+	f->head = "VACF\n";
+	std::ostringstream tail;
+	tail << "VACF integral: " << intAcfVel << '\n';
+	f->tail = tail.str();
+	asyncOutPublish(*asyncOut);
+}
+
@@ -0,0 +1,149 @@
+struct AsyncOut;
+
+/*
+ * One simulation: what used to be the globals of md.cpp, and the functions
+ * working on them. Runs share nothing, so several can step side by side on
+ * different threads.
+ */
+struct Sim {
+	int initRun(std::map<std::string, std::string> &, std::string, std::string);
+	void runSteps();
+	void endRun(long);
+
+	void singleStep();
+	void buildNebrList();
+	void computeForces(int, int);
+	void respaForces(int);
+	void buildInnerList();
+	void evalRdf();
+	void evalDiffusion();
+	void evalVacf();
+
+	void setParams();
+	void allocRun(Arena &);
+	void allocSlots(Arena &);
+	void growNebrTab();
+	void openOutputs(std::string);
+	void flushOutputs();
+	void closeOutputs();
+	std::vector<double> ckptHeader();
+	void writeCheckpoint(std::string);
+	int readCheckpoint(std::string);
+	void ckptState(std::fstream &, int);
+	void writeFrame(OutFrame &);
+	void printPerf();
+	void initAtoms();
+	void rescaleVels(double);
+	void accumProps(int);
+	void leapfrogStep(int);
+	void kickAtoms(int, int, double, double *);
+	void wrapPositions();
+	void reorderMol();
+	void adaptNebrShell(double);
+	void evalProps();
+	void printSummary();
+	void posDump();
+	void rdfPair(double *, int, int, double);
+	void printRdf();
+	void evalLatticeCorr();
+	void initDiffusion();
+	void zeroDiffusion();
+	void accumDiffusion();
+	void reportDiffusion(double);
+	void printMsd(double);
+	void printDiffusion();
+	void initVacf();
+	void zeroVacf();
+	void accumVacf();
+	void reportVacf(double);
+	void printVacf();
+	void unwrapPositions();
+	void evalCorrFft();
+	void computeCorrFft();
+	void initMultiTau();
+	void evalMultiTau();
+	void pushMultiTau(int);
+	void reportMultiTau();
+	void reduceAll(double *, int, int);
+	int ddInit();
+	void ddGrow(int);
+	void ddPackAtom(std::vector<double> &, int);
+	void ddUnpackAtom(const double *, int);
+	void ddMigrate();
+	void ddHaloBuild();
+	void ddHaloUpdate();
+	void ddHaloReverse();
+	void ddBinCells(double);
+	int ddCellNebrs(int, int *);
+	void ddBuildNebrList();
+	void ddRdfPairs(double *, double);
+	void ddGather(double *, double *, double *);
+
+	double rCut, density, temperature, deltaT, timeNow;
+	double uSum, virSum;
+	vecR cells, initUcell, region, momSum;
+	int nDim, nMol, nMolA, nMolB;
+	int stepCount, stepEquil, stepRun, stepLimit;
+	int stepAdjTemp, stepAvg, stepDump;
+	Prop kinEnergy, totEnergy, pressure;
+	Mol mol, molTmp;
+	int *molSlot, *typeIdx;
+	int *cellStart, *cellAtom, *cellOf, *cellCount, nCell;
+	double rNebrShell, rNebrShellMax, *nebrRx, *nebrRy, *nebrRz;
+	int *nebrTab, *nebrStart, *nebrOff, nebrNow, nebrTabFac, nebrTabLen, nebrTabMax;
+	int nebrCount, nebr_adapt = 0, stepNebrAdapt, nebrWinSteps;
+	double nebrWinTime, nebrCostPrev, nebrShellDir;
+	std::vector<std::vector<int>> nebrBuff;
+	int num_atoms, cell_list = 1, neigh_list = 1, sort_atoms = 1, corr_mode = 0;
+	double *histRdf, *histRdfThr, rangeRdf;
+	std::vector<int> rdfPairCol;
+	int nPairRdf, sizeHistRdfPad;
+	int countRdf, limitRdf, sizeHistRdf, stepRdf;
+	int *rdfCellStart, *rdfCellAtom, *rdfCellOf, nCellRdf;
+	vecR cellsRdf;
+	double latticeCorr;
+	std::vector<Tbuff> bufferAA, bufferBB, bufferAB;
+	double *rrDiffAvgAA, *rrDiffAvgBB, *rrDiffAvgAB;
+	int countDiffAvg, limitDiffAvg, nBuffDiff, nValDiff, stepDiff;
+	std::vector<Vbuff> vacBuff;
+	double *avgAcfVel, intAcfVel;
+	int countAcfAvg, limitAcfAvg, nBuffAcf, nValAcf, stepAcf;
+	double *corrPos, *corrVel;
+	vecR *corrRUnw;
+	int nCorr, countCorr;
+	double *tauPos, *tauVel, *tauPosNow, *tauVelAcc, *tauMsd, *tauAcf, *tauCount;
+	int nLevTau, pTau, mTau, nRowTau, *tauFill, *tauHead, *tauAccN, countTau;
+	double nAlpha, nBeta, mass1, mass2, mRatio, Q;
+	double epsAA = 1.0, epsBB = 0.50, epsAB = 1.5;
+	double sigAA = 1.0, sigBB = 0.88, sigAB = 0.8;
+	std::vector<LJpair> ljTab;
+	int nType;
+	double *accBuff;
+	int nThreads, nMolPad;
+	double *propThr, mv2Sum;
+	int nRespa = 1, *nebrStartIn, *nebrTabIn, nebrTabLenIn;
+	double rRespa, uLong, virLong, *alx, *aly, *alz;
+	std::vector<LJpair> ljTabIn;
+	PairKernel pairKernel;
+	std::ofstream outFile, dumpFile, rdfFile, msdFile, dfsFile, acfFile;
+	std::vector<char> outBuff[6];
+	int stepFlush, sizeOutBuff;
+	TrajInfo trajInfo;
+	int nOutSlot;
+	std::string ckptBase;
+	int stepStart, stepCkpt;
+	double pairCount, secsRun;
+	int nStepRun;
+	AsyncOut *asyncOut;
+	// the buffers of the run; slot and neighbor buffers that outgrow their
+	// first size move to arenas of their own
+	Arena arena, arenaSlot, arenaNebr;
+	double perfSecs[N_PERF];
+	int nRank = 1, rank = 0, nLocal, nGhost, nMolMax, ddRecLen;
+	int procGrid[3], procPos[3], procLo[3], procHi[3];
+	double subLo[3], subHi[3], rHalo;
+	std::vector<int> haloSend[6], ddCellStart, ddCellAtom, ddCellOf;
+	int haloFirst[6], haloCount[6], ddCells[3];
+	double haloShift[6];
+	std::vector<double> ddOut, ddIn, ddOut2, ddIn2;
+};
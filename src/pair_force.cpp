@@ -0,0 +1,280 @@
+#include <string>
+#include <immintrin.h>
+#include "types.hpp"
+#include "pair_force.hpp"
+
+/*
+ * LJ forces for atoms iLo..iHi-1 over the half neighbor list. Pair forces
+ * are added to (fx, fy, fz) for both atoms, virSum gets f.r and uSum12
+ * gets 12 times the shifted pair energy.
+ */
+void pairForceScalar(const PairArgs &a, int iLo, int iHi,
+		double *fx, double *fy, double *fz, double &uSum12, double &virSum) {
+	const double *rx = a.rx, *ry = a.ry, *rz = a.rz;
+	const int *type = a.type;
+	double lx = a.region.x, ly = a.region.y, lz = a.region.z;
+	double hx = 0.5 * lx, hy = 0.5 * ly, hz = 0.5 * lz;
+	double uS = 0, virS = 0;
+
+	for (int i = iLo; i < iHi; i++) {
+		double xi = rx[i], yi = ry[i], zi = rz[i];
+		double fxi = 0, fyi = 0, fzi = 0;
+		const LJpair *ljRow = a.ljTab + (type[i]-1)*a.nType;
+		for (int k = a.nebrStart[i]; k < a.nebrStart[i+1]; k++) {
+			int j = a.nebrTab[k];
+			double dx = xi - rx[j], dy = yi - ry[j], dz = zi - rz[j];
+			dx -= lx * ((dx >= hx) - (dx < -hx));
+			dy -= ly * ((dy >= hy) - (dy < -hy));
+			dz -= lz * ((dz >= hz) - (dz < -hz));
+			double rr = dx*dx + dy*dy + dz*dz;
+			const LJpair &lj = ljRow[type[j]-1];
+			if (rr < lj.rrCut) {
+				double ri2 = 1.0 / rr;
+				double ri6 = ri2 * ri2 * ri2;
+				double fcVal = (lj.fc12 * ri6 - lj.fc6) * ri6 * ri2;
+				fxi += fcVal * dx;
+				fyi += fcVal * dy;
+				fzi += fcVal * dz;
+				fx[j] -= fcVal * dx;
+				fy[j] -= fcVal * dy;
+				fz[j] -= fcVal * dz;
+				uS += (lj.fc12 * ri6 - 2.0 * lj.fc6) * ri6 - 12.0 * lj.uShift;
+				virS += fcVal * rr;
+			}
+		}
+		fx[i] += fxi;
+		fy[i] += fyi;
+		fz[i] += fzi;
+	}
+
+	uSum12 += uS;
+	virSum += virS;
+}
+
+__attribute__((target("avx2,fma")))
+static double hsum256(__m256d v) {
+	__m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+	return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+/*
+ * four neighbors per iteration; gathered positions and coefficients,
+ * the cutoff test is a lane mask and the scatter to the neighbors is
+ * done lane by lane so repeated indices are safe
+ */
+__attribute__((target("avx2,fma")))
+void pairForceAvx2(const PairArgs &a, int iLo, int iHi,
+		double *fx, double *fy, double *fz, double &uSum12, double &virSum) {
+	const double *rx = a.rx, *ry = a.ry, *rz = a.rz;
+	const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0);
+	const __m256d two = _mm256_set1_pd(2.0), twelve = _mm256_set1_pd(12.0);
+	const __m256d lx = _mm256_set1_pd(a.region.x), hx = _mm256_set1_pd(0.5 * a.region.x);
+	const __m256d ly = _mm256_set1_pd(a.region.y), hy = _mm256_set1_pd(0.5 * a.region.y);
+	const __m256d lz = _mm256_set1_pd(a.region.z), hz = _mm256_set1_pd(0.5 * a.region.z);
+	const __m256d nhx = _mm256_sub_pd(zero, hx), nhy = _mm256_sub_pd(zero, hy);
+	const __m256d nhz = _mm256_sub_pd(zero, hz);
+	const __m128i lane = _mm_setr_epi32(0, 1, 2, 3), ione = _mm_set1_epi32(1);
+	__m256d uAcc = zero, vAcc = zero;
+	alignas(32) double cx[4], cy[4], cz[4];
+	alignas(16) int jn[4];
+
+	for (int i = iLo; i < iHi; i++) {
+		__m256d xi = _mm256_set1_pd(rx[i]), yi = _mm256_set1_pd(ry[i]);
+		__m256d zi = _mm256_set1_pd(rz[i]);
+		__m256d fxi = zero, fyi = zero, fzi = zero;
+		const double *ljRow = &a.ljTab[(a.type[i]-1)*a.nType].fc12;
+		int kHi = a.nebrStart[i+1];
+		for (int k = a.nebrStart[i]; k < kHi; k += 4) {
+			int n = kHi - k < 4 ? kHi - k : 4;
+			__m128i mi = _mm_cmpgt_epi32(_mm_set1_epi32(n), lane);
+			__m256d md = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(mi));
+			__m128i jv = _mm_maskload_epi32(a.nebrTab + k, mi);
+
+			__m256d dx = _mm256_sub_pd(xi, _mm256_mask_i32gather_pd(zero, rx, jv, md, 8));
+			__m256d dy = _mm256_sub_pd(yi, _mm256_mask_i32gather_pd(zero, ry, jv, md, 8));
+			__m256d dz = _mm256_sub_pd(zi, _mm256_mask_i32gather_pd(zero, rz, jv, md, 8));
+			dx = _mm256_add_pd(_mm256_sub_pd(dx, _mm256_and_pd(_mm256_cmp_pd(dx, hx, _CMP_GE_OQ), lx)),
+				_mm256_and_pd(_mm256_cmp_pd(dx, nhx, _CMP_LT_OQ), lx));
+			dy = _mm256_add_pd(_mm256_sub_pd(dy, _mm256_and_pd(_mm256_cmp_pd(dy, hy, _CMP_GE_OQ), ly)),
+				_mm256_and_pd(_mm256_cmp_pd(dy, nhy, _CMP_LT_OQ), ly));
+			dz = _mm256_add_pd(_mm256_sub_pd(dz, _mm256_and_pd(_mm256_cmp_pd(dz, hz, _CMP_GE_OQ), lz)),
+				_mm256_and_pd(_mm256_cmp_pd(dz, nhz, _CMP_LT_OQ), lz));
+			__m256d rr = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx),
+				_mm256_mul_pd(dy, dy)), _mm256_mul_pd(dz, dz));
+
+			// offset of each neighbor's LJpair in the row, in doubles
+			__m128i tj = _mm_mask_i32gather_epi32(_mm_setzero_si128(), a.type, jv, mi, 4);
+			__m128i li = _mm_slli_epi32(_mm_sub_epi32(tj, ione), 2);
+			__m256d rrCut = _mm256_mask_i32gather_pd(zero, ljRow + 2, li, md, 8);
+			__m256d c = _mm256_and_pd(md, _mm256_cmp_pd(rr, rrCut, _CMP_LT_OQ));
+			if (_mm256_movemask_pd(c) == 0) {
+				continue;
+			}
+			__m256d fc12 = _mm256_mask_i32gather_pd(zero, ljRow, li, c, 8);
+			__m256d fc6 = _mm256_mask_i32gather_pd(zero, ljRow + 1, li, c, 8);
+			__m256d uShift = _mm256_mask_i32gather_pd(zero, ljRow + 3, li, c, 8);
+
+			__m256d ri2 = _mm256_div_pd(one, _mm256_blendv_pd(one, rr, c));
+			__m256d ri6 = _mm256_mul_pd(_mm256_mul_pd(ri2, ri2), ri2);
+			__m256d fcVal = _mm256_mul_pd(_mm256_mul_pd(_mm256_sub_pd(
+				_mm256_mul_pd(fc12, ri6), fc6), ri6), ri2);
+			fcVal = _mm256_and_pd(fcVal, c);
+			__m256d fcx = _mm256_mul_pd(fcVal, dx);
+			__m256d fcy = _mm256_mul_pd(fcVal, dy);
+			__m256d fcz = _mm256_mul_pd(fcVal, dz);
+			fxi = _mm256_add_pd(fxi, fcx);
+			fyi = _mm256_add_pd(fyi, fcy);
+			fzi = _mm256_add_pd(fzi, fcz);
+			__m256d u = _mm256_sub_pd(_mm256_mul_pd(_mm256_sub_pd(_mm256_mul_pd(fc12, ri6),
+				_mm256_mul_pd(two, fc6)), ri6), _mm256_mul_pd(twelve, uShift));
+			uAcc = _mm256_add_pd(uAcc, _mm256_and_pd(u, c));
+			vAcc = _mm256_add_pd(vAcc, _mm256_mul_pd(fcVal, rr));
+
+			_mm256_store_pd(cx, fcx);
+			_mm256_store_pd(cy, fcy);
+			_mm256_store_pd(cz, fcz);
+			_mm_store_si128((__m128i *) jn, jv);
+			for (int l = 0; l < n; l++) {
+				fx[jn[l]] -= cx[l];
+				fy[jn[l]] -= cy[l];
+				fz[jn[l]] -= cz[l];
+			}
+		}
+		fx[i] += hsum256(fxi);
+		fy[i] += hsum256(fyi);
+		fz[i] += hsum256(fzi);
+	}
+
+	uSum12 += hsum256(uAcc);
+	virSum += hsum256(vAcc);
+}
+
+__attribute__((target("avx512f")))
+static double hsum512(__m512d v) {
+	alignas(64) double t[8];
+	_mm512_store_pd(t, v);
+	return ((t[0] + t[4]) + (t[2] + t[6])) + ((t[1] + t[5]) + (t[3] + t[7]));
+}
+
+/*
+ * eight neighbors per iteration with mask registers; the scatter is
+ * vectorized unless two lanes hold the same neighbor, then it goes lane
+ * by lane; a list holds an atom twice only when r_cut plus the skin is
+ * more than half the box, which initRun() refuses
+ */
+__attribute__((target("avx512f,avx512vl,avx512cd")))
+void pairForceAvx512(const PairArgs &a, int iLo, int iHi,
+		double *fx, double *fy, double *fz, double &uSum12, double &virSum) {
+	const double *rx = a.rx, *ry = a.ry, *rz = a.rz;
+	const __m512d zero = _mm512_setzero_pd(), one = _mm512_set1_pd(1.0);
+	const __m512d two = _mm512_set1_pd(2.0), twelve = _mm512_set1_pd(12.0);
+	const __m512d lx = _mm512_set1_pd(a.region.x), hx = _mm512_set1_pd(0.5 * a.region.x);
+	const __m512d ly = _mm512_set1_pd(a.region.y), hy = _mm512_set1_pd(0.5 * a.region.y);
+	const __m512d lz = _mm512_set1_pd(a.region.z), hz = _mm512_set1_pd(0.5 * a.region.z);
+	const __m512d nhx = _mm512_sub_pd(zero, hx), nhy = _mm512_sub_pd(zero, hy);
+	const __m512d nhz = _mm512_sub_pd(zero, hz);
+	const __m256i ione = _mm256_set1_epi32(1), izero = _mm256_setzero_si256();
+	__m512d uAcc = zero, vAcc = zero;
+	alignas(64) double cx[8], cy[8], cz[8];
+	alignas(32) int jn[8];
+
+	for (int i = iLo; i < iHi; i++) {
+		__m512d xi = _mm512_set1_pd(rx[i]), yi = _mm512_set1_pd(ry[i]);
+		__m512d zi = _mm512_set1_pd(rz[i]);
+		__m512d fxi = zero, fyi = zero, fzi = zero;
+		const double *ljRow = &a.ljTab[(a.type[i]-1)*a.nType].fc12;
+		int kHi = a.nebrStart[i+1];
+		for (int k = a.nebrStart[i]; k < kHi; k += 8) {
+			int n = kHi - k < 8 ? kHi - k : 8;
+			__mmask8 m = (1u << n) - 1;
+			__m256i jv = _mm256_maskz_loadu_epi32(m, a.nebrTab + k);
+
+			__m512d dx = _mm512_sub_pd(xi, _mm512_mask_i32gather_pd(zero, m, jv, rx, 8));
+			__m512d dy = _mm512_sub_pd(yi, _mm512_mask_i32gather_pd(zero, m, jv, ry, 8));
+			__m512d dz = _mm512_sub_pd(zi, _mm512_mask_i32gather_pd(zero, m, jv, rz, 8));
+			__mmask8 gx = _mm512_cmp_pd_mask(dx, hx, _CMP_GE_OQ);
+			__mmask8 sx = _mm512_cmp_pd_mask(dx, nhx, _CMP_LT_OQ);
+			__mmask8 gy = _mm512_cmp_pd_mask(dy, hy, _CMP_GE_OQ);
+			__mmask8 sy = _mm512_cmp_pd_mask(dy, nhy, _CMP_LT_OQ);
+			__mmask8 gz = _mm512_cmp_pd_mask(dz, hz, _CMP_GE_OQ);
+			__mmask8 sz = _mm512_cmp_pd_mask(dz, nhz, _CMP_LT_OQ);
+			dx = _mm512_mask_add_pd(_mm512_mask_sub_pd(dx, gx, dx, lx), sx, dx, lx);
+			dy = _mm512_mask_add_pd(_mm512_mask_sub_pd(dy, gy, dy, ly), sy, dy, ly);
+			dz = _mm512_mask_add_pd(_mm512_mask_sub_pd(dz, gz, dz, lz), sz, dz, lz);
+			__m512d rr = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(dx, dx),
+				_mm512_mul_pd(dy, dy)), _mm512_mul_pd(dz, dz));
+
+			__m256i tj = _mm256_mmask_i32gather_epi32(izero, m, jv, a.type, 4);
+			__m256i li = _mm256_slli_epi32(_mm256_sub_epi32(tj, ione), 2);
+			__m512d rrCut = _mm512_mask_i32gather_pd(zero, m, li, ljRow + 2, 8);
+			__mmask8 c = _mm512_mask_cmp_pd_mask(m, rr, rrCut, _CMP_LT_OQ);
+			if (c == 0) {
+				continue;
+			}
+			__m512d fc12 = _mm512_mask_i32gather_pd(zero, c, li, ljRow, 8);
+			__m512d fc6 = _mm512_mask_i32gather_pd(zero, c, li, ljRow + 1, 8);
+			__m512d uShift = _mm512_mask_i32gather_pd(zero, c, li, ljRow + 3, 8);
+
+			__m512d ri2 = _mm512_mask_div_pd(one, c, one, rr);
+			__m512d ri6 = _mm512_mul_pd(_mm512_mul_pd(ri2, ri2), ri2);
+			__m512d fcVal = _mm512_maskz_mul_pd(c, _mm512_mul_pd(_mm512_sub_pd(
+				_mm512_mul_pd(fc12, ri6), fc6), ri6), ri2);
+			__m512d fcx = _mm512_mul_pd(fcVal, dx);
+			__m512d fcy = _mm512_mul_pd(fcVal, dy);
+			__m512d fcz = _mm512_mul_pd(fcVal, dz);
+			fxi = _mm512_add_pd(fxi, fcx);
+			fyi = _mm512_add_pd(fyi, fcy);
+			fzi = _mm512_add_pd(fzi, fcz);
+			__m512d u = _mm512_sub_pd(_mm512_mul_pd(_mm512_sub_pd(_mm512_mul_pd(fc12, ri6),
+				_mm512_mul_pd(two, fc6)), ri6), _mm512_mul_pd(twelve, uShift));
+			uAcc = _mm512_mask_add_pd(uAcc, c, uAcc, u);
+			vAcc = _mm512_add_pd(vAcc, _mm512_mul_pd(fcVal, rr));
+
+			__m256i conf = _mm256_maskz_conflict_epi32(c, jv);
+			if (_mm256_mask_test_epi32_mask(c, conf, conf) == 0) {
+				_mm512_mask_i32scatter_pd(fx, c, jv, _mm512_sub_pd(
+					_mm512_mask_i32gather_pd(zero, c, jv, fx, 8), fcx), 8);
+				_mm512_mask_i32scatter_pd(fy, c, jv, _mm512_sub_pd(
+					_mm512_mask_i32gather_pd(zero, c, jv, fy, 8), fcy), 8);
+				_mm512_mask_i32scatter_pd(fz, c, jv, _mm512_sub_pd(
+					_mm512_mask_i32gather_pd(zero, c, jv, fz, 8), fcz), 8);
+			} else {
+				_mm512_store_pd(cx, fcx);
+				_mm512_store_pd(cy, fcy);
+				_mm512_store_pd(cz, fcz);
+				_mm256_store_si256((__m256i *) jn, jv);
+				for (int l = 0; l < n; l++) {
+					fx[jn[l]] -= cx[l];
+					fy[jn[l]] -= cy[l];
+					fz[jn[l]] -= cz[l];
+				}
+			}
+		}
+		fx[i] += hsum512(fxi);
+		fy[i] += hsum512(fyi);
+		fz[i] += hsum512(fzi);
+	}
+
+	uSum12 += hsum512(uAcc);
+	virSum += hsum512(vAcc);
+}
+
+/*
+ * kernel by name: "scalar", "avx2", "avx512" or "auto" for the widest
+ * one this CPU supports; null if the CPU lacks the requested one
+ */
+PairKernel selectPairKernel(std::string name) {
+	__builtin_cpu_init();
+	bool avx512 = __builtin_cpu_supports("avx512f")
+		&& __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512cd");
+	bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+
+	if (name == "avx512" || (name == "auto" && avx512)) {
+		return avx512 ? pairForceAvx512 : nullptr;
+	} else if (name == "avx2" || (name == "auto" && avx2)) {
+		return avx2 ? pairForceAvx2 : nullptr;
+	} else if (name == "scalar" || name == "auto") {
+		return pairForceScalar;
+	}
+	return nullptr;
+}
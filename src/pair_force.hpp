@@ -0,0 +1,8 @@
+void pairForceScalar(const PairArgs &, int, int,
+		double *, double *, double *, double &, double &);
+void pairForceAvx2(const PairArgs &, int, int,
+		double *, double *, double *, double &, double &);
+void pairForceAvx512(const PairArgs &, int, int,
+		double *, double *, double *, double &, double &);
+
+PairKernel selectPairKernel(std::string);
@@ -0,0 +1,42 @@
+#include <chrono>
+#include <vector>
+#include <utility>
+#include "perf.hpp"
+
+/*
+ * Cumulative phase timers, added into the N_PERF seconds of a run. Phases
+ * nest: starting one pauses the phase running on the same thread, which
+ * resumes when the inner one stops, so every second is charged to exactly
+ * one phase. Each thread keeps its own stack; a phase of a run must only
+ * ever be timed from one thread.
+ */
+static thread_local std::vector<std::pair<double *, int>> perfStack;
+static thread_local std::chrono::steady_clock::time_point perfLast;
+
+static const char *perfNames[N_PERF] = {"integrate", "neighbor list", "forces",
+	"comm", "properties", "rdf", "msd/diffusion", "vacf", "output queue", "dump queue",
+	"checkpoint", "write dump", "write text"};
+
+// charges the time since the last switch to the running phase
+static void perfSwitch() {
+	auto now = std::chrono::steady_clock::now();
+	if (!perfStack.empty()) {
+		std::chrono::duration<double> dt = now - perfLast;
+		perfStack.back().first[perfStack.back().second] += dt.count();
+	}
+	perfLast = now;
+}
+
+void perfStart(double *secs, int phase) {
+	perfSwitch();
+	perfStack.push_back({secs, phase});
+}
+
+void perfStop() {
+	perfSwitch();
+	perfStack.pop_back();
+}
+
+const char *perfName(int phase) {
+	return perfNames[phase];
+}
@@ -0,0 +1,20 @@
+// phases timed by perfStart()/perfStop(); the last two run on the output
+// thread when there is one
+#define PERF_INTEGRATE 0
+#define PERF_NEBR 1
+#define PERF_FORCE 2
+#define PERF_COMM 3
+#define PERF_PROPS 4
+#define PERF_RDF 5
+#define PERF_DIFF 6
+#define PERF_VACF 7
+#define PERF_OUTPUT 8
+#define PERF_DUMP 9
+#define PERF_CKPT 10
+#define PERF_WRITE_DUMP 11
+#define PERF_WRITE_TEXT 12
+#define N_PERF 13
+
+void perfStart(double *, int);
+void perfStop();
+const char *perfName(int);
@@ -0,0 +1,190 @@
+#include <iostream>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "types.hpp"
+#include "traj.hpp"
+
+/*
+ * Binary trajectory. The file is a sequence of blocks, each starting with
+ * a four byte tag: "TRJH" for a header (version, nMol, mode, prec, then
+ * nMol atom types) and "TRJF" for a frame (time, box, then x, y and z of
+ * all atoms in id order). A restarted run appending to the same file just
+ * writes a new header. Everything is in native byte order.
+ *
+ * TRAJ_PACKED frames store each axis as integers round(x / prec) relative
+ * to their minimum, bit packed with just enough bits for the range:
+ * int32 qMin, int32 nBits, then (nMol * nBits + 63) / 64 uint64 words.
+ */
+static const char tagHeader[4] = {'T', 'R', 'J', 'H'};
+static const char tagFrame[4] = {'T', 'R', 'J', 'F'};
+static const int32_t trajVersion = 1;
+
+template <typename T>
+static void put(std::ostream &os, T val) {
+	os.write(reinterpret_cast<const char *>(&val), sizeof(T));
+}
+
+template <typename T>
+static T get(std::istream &is) {
+	T val = 0;
+	is.read(reinterpret_cast<char *>(&val), sizeof(T));
+	return val;
+}
+
+static void packAxis(std::ostream &os, const double *r, int n, double prec) {
+	static thread_local std::vector<int64_t> q;
+	static thread_local std::vector<uint64_t> word;
+	q.resize(n);
+	int64_t qMin = 0, qMax = 0;
+	for (int i = 0; i < n; i++) {
+		q[i] = std::llround(r[i] / prec);
+		if (i == 0 || q[i] < qMin) qMin = q[i];
+		if (i == 0 || q[i] > qMax) qMax = q[i];
+	}
+	int nBits = 1;
+	while (nBits < 32 && (qMax - qMin) >> nBits) nBits++;
+
+	word.assign((int64_t(n) * nBits + 63) / 64, 0);
+	int64_t bit = 0;
+	for (int i = 0; i < n; i++, bit += nBits) {
+		uint64_t v = uint64_t(q[i] - qMin);
+		int w = bit >> 6, s = bit & 63;
+		word[w] |= v << s;
+		if (s + nBits > 64) {
+			word[w+1] |= v >> (64 - s);
+		}
+	}
+	put<int32_t>(os, qMin);
+	put<int32_t>(os, nBits);
+	os.write(reinterpret_cast<const char *>(word.data()), word.size() * sizeof(uint64_t));
+}
+
+// 0 if the width read is not one the writer uses
+static int unpackAxis(std::istream &is, double *r, int n, double prec) {
+	static thread_local std::vector<uint64_t> word;
+	int64_t qMin = get<int32_t>(is);
+	int nBits = get<int32_t>(is);
+	if (!is || nBits < 1 || nBits > 32) {
+		return 0;
+	}
+	word.assign((int64_t(n) * nBits + 63) / 64 + 1, 0);
+	is.read(reinterpret_cast<char *>(word.data()), (word.size() - 1) * sizeof(uint64_t));
+
+	uint64_t mask = (uint64_t(1) << nBits) - 1;
+	int64_t bit = 0;
+	for (int i = 0; i < n; i++, bit += nBits) {
+		int w = bit >> 6, s = bit & 63;
+		uint64_t v = word[w] >> s;
+		if (s + nBits > 64) {
+			v |= word[w+1] << (64 - s);
+		}
+		r[i] = (int64_t(v & mask) + qMin) * prec;
+	}
+	return 1;
+}
+
+void trajWriteHeader(std::ostream &os, const TrajInfo &info) {
+	os.write(tagHeader, 4);
+	put<int32_t>(os, trajVersion);
+	put<int32_t>(os, info.nMol);
+	put<int32_t>(os, info.mode);
+	put<double>(os, info.prec);
+	for (int n = 0; n < info.nMol; n++) {
+		put<int32_t>(os, info.type[n]);
+	}
+}
+
+void trajWriteFrame(std::ostream &os, const TrajInfo &info, double time,
+		vecR region, const double *x, const double *y, const double *z) {
+	const double *r[3] = {x, y, z};
+	int n = info.nMol;
+
+	os.write(tagFrame, 4);
+	put<double>(os, time);
+	put<double>(os, region.x);
+	put<double>(os, region.y);
+	put<double>(os, region.z);
+	for (int k = 0; k < 3; k++) {
+		if (info.mode == TRAJ_PACKED) {
+			packAxis(os, r[k], n, info.prec);
+		} else if (info.mode == TRAJ_FLOAT) {
+			for (int i = 0; i < n; i++) {
+				put<float>(os, float(r[k][i]));
+			}
+		} else {
+			os.write(reinterpret_cast<const char *>(r[k]), n * sizeof(double));
+		}
+	}
+}
+
+/*
+ * reads the next block: returns 1 for a header (info.type is reallocated,
+ * x, y and z must then hold info.nMol values), 2 for a frame, 0 at the end
+ * of the file and -1 on a malformed block: a header with no atoms, an
+ * unknown mode, a packed precision that is not positive or fewer bytes
+ * left than its types take, or a packed axis of 0 or more than 32 bits
+ */
+int trajReadBlock(std::istream &is, TrajInfo &info, double &time,
+		vecR &region, double *x, double *y, double *z) {
+	char tag[4];
+	if (!is.read(tag, 4)) {
+		return 0;
+	}
+
+	if (std::memcmp(tag, tagHeader, 4) == 0) {
+		if (get<int32_t>(is) != trajVersion) {
+			return -1;
+		}
+		int nMol = get<int32_t>(is), mode = get<int32_t>(is);
+		double prec = get<double>(is);
+		// checked before anything is sized from them
+		if (!is || nMol <= 0 || mode < TRAJ_FLOAT || mode > TRAJ_PACKED
+				|| (mode == TRAJ_PACKED && !(prec > 0))) {
+			return -1;
+		}
+		std::streampos at = is.tellg();
+		if (at != std::streampos(-1)) {
+			is.seekg(0, std::ios::end);
+			std::streamoff left = is.tellg() - at;
+			is.seekg(at);
+			if (left < std::streamoff(nMol) * 4) {
+				return -1;
+			}
+		}
+		info.nMol = nMol;
+		info.mode = mode;
+		info.prec = prec;
+		delete[] info.type;
+		info.type = new int[info.nMol];
+		for (int n = 0; n < info.nMol; n++) {
+			info.type[n] = get<int32_t>(is);
+		}
+		return is ? 1 : -1;
+	}
+	if (std::memcmp(tag, tagFrame, 4) != 0 || !info.type) {
+		return -1;
+	}
+
+	double *r[3] = {x, y, z};
+	int n = info.nMol;
+	time = get<double>(is);
+	region.x = get<double>(is);
+	region.y = get<double>(is);
+	region.z = get<double>(is);
+	for (int k = 0; k < 3; k++) {
+		if (info.mode == TRAJ_PACKED) {
+			if (!unpackAxis(is, r[k], n, info.prec)) {
+				return -1;
+			}
+		} else if (info.mode == TRAJ_FLOAT) {
+			for (int i = 0; i < n; i++) {
+				r[k][i] = get<float>(is);
+			}
+		} else {
+			is.read(reinterpret_cast<char *>(r[k]), n * sizeof(double));
+		}
+	}
+	return is ? 2 : -1;
+}
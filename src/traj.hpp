@@ -0,0 +1,11 @@
+// frame encodings of the binary trajectory; TRAJ_TEXT is the text dump
+#define TRAJ_TEXT 0
+#define TRAJ_FLOAT 1
+#define TRAJ_DOUBLE 2
+#define TRAJ_PACKED 3
+
+void trajWriteHeader(std::ostream &, const TrajInfo &);
+void trajWriteFrame(std::ostream &, const TrajInfo &, double, vecR,
+		const double *, const double *, const double *);
+int trajReadBlock(std::istream &, TrajInfo &, double &, vecR &,
+		double *, double *, double *);
@@ -3,17 +3,33 @@ typedef struct {
 } vecR;
 
 typedef struct {
-	vecR r, vel, acc;
-	double mass;
-	int type;
+	int x, y, z;
+} vecI;
+
+// im* count the periodic images crossed, so r + im * region is unwrapped
+typedef struct {
+	double *rx, *ry, *rz;
+	double *vx, *vy, *vz;
+	double *ax, *ay, *az;
+	double *mass;
+	int *type, *id;
+	int *imx, *imy, *imz;
 } Mol;
 
 typedef struct {
 	double val, sum, sum2;
 } Prop;
 
+// LJ coefficients for one pair of species: 48 eps sig^12, 24 eps sig^6,
+// squared cutoff and the potential value at the cutoff
+typedef struct {
+	double fc12, fc6, rrCut, uShift;
+} LJpair;
+
+// origins of one species, indexed by the position of an atom within it
 typedef struct {
-	vecR *orgR, *rTrue;
+	vecR *orgR;
+	vecI *orgIm;
 	double *rrDiff;
 	int count;
 } Tbuff;
@@ -23,3 +39,34 @@ typedef struct {
 	double *acfVel;
 	int count;
 } Vbuff;
+
+// inputs of the pair force kernels; the neighbor list is the CSR half list
+typedef struct {
+	const double *rx, *ry, *rz;
+	const int *type, *nebrStart, *nebrTab;
+	const LJpair *ljTab;
+	int nType;
+	vecR region;
+} PairArgs;
+
+typedef void (*PairKernel)(const PairArgs &, int, int,
+		double *, double *, double *, double &, double &);
+
+// binary trajectory: atom count, frame encoding (TRAJ_*), quantisation
+// step for TRAJ_PACKED and atom types in id order
+typedef struct {
+	int nMol, mode;
+	double prec;
+	int *type;
+} TrajInfo;
+
+// one queued write for the output thread: a position frame, a summary
+// line, a table of nRow x nCol values between two text lines, or a flush
+typedef struct {
+	int kind, step, nRow, nCol;
+	double time;
+	vecR region;
+	double *data;
+	std::ostream *file;
+	std::string head, tail;
+} OutFrame;
@@ -1,5 +1,7 @@
 #include <cmath>
 #include <algorithm>
+#include <iostream>
+#include <string>
 #include "types.hpp"
 
 double Sqr(double x) {
@@ -0,0 +1,85 @@
+#!/bin/bash
+# Runs inputs that must be rejected and checks that each stops with a
+# message and a nonzero status rather than a crash or a hang. From the
+# top directory:
+#   bash test/badinput.sh
+dir=$(mktemp -d)
+g++ -O2 -fopenmp src/*.cpp -o $dir/md || exit 1
+g++ -O2 -Isrc tools/trj2dump.cpp src/traj.cpp -o $dir/trj2dump || exit 1
+cd $dir
+cat > base.in <<EOF
+temperature = 1
+density = 0.8
+num_atoms = 256
+mass_ratio = 1
+delta_t = 0.005
+step_equil = 10
+step_run = 100
+step_ckpt = 0
+EOF
+echo garbage > bad.ckpt
+# checkpoints of runs the inputs below differ from
+{ cat base.in; echo 'n_respa = 2'; } > r.in
+./md r.in > /dev/null
+{ cat base.in; printf 'corr_mode = 1\nn_val_diff = 10\nn_corr = 40\n'; } > c.in
+./md c.in > /dev/null
+{ cat base.in; echo 'corr_mode = 2'; } > m.in
+./md m.in > /dev/null
+cat r.equil.ckpt bad.ckpt > long.ckpt
+# a packed trajectory of 256 atoms, then copies with a negative atom
+# count, an axis of 0 bits, and the types cut short
+{ cat base.in; printf 'traj_mode = packed\nstep_dump = 50\n'; } > p.in
+./md p.in > /dev/null
+patch() {
+	cp p.trj $1.trj
+	printf "$3" | dd of=$1.trj bs=1 seek=$2 conv=notrunc 2> /dev/null
+}
+patch neg 8 '\xff\xff\xff\xff'
+patch bits0 $((24 + 4 * 256 + 40)) '\x00\x00\x00\x00'
+head -c 500 p.trj > short.trj
+
+fail=0
+# name, extra input lines, then any further arguments
+check() {
+	name=$1 extra=$2
+	shift 2
+	{ cat base.in; printf "$extra"; } > t.in
+	timeout 60 "$@" > log 2>&1
+	status=$?
+	if [ $status = 0 ] || [ $status = 124 ] || [ $status -ge 128 ]; then
+		echo "$name: status $status"
+		fail=1
+	fi
+	rm -f t.*
+}
+
+check "unknown key" 'no_such_key = 1\n' ./md t.in
+check "traj_mode" 'traj_mode = foo\n' ./md t.in
+check "pair_kernel" 'pair_kernel = neon\n' ./md t.in
+check "checkpoint" '' ./md t.in bad.ckpt
+check "step_acf" 'corr_mode = 1\nstep_acf = 5\n' ./md t.in
+check "n_corr" 'corr_mode = 1\nn_val_diff = 20\nn_corr = 10\n' ./md t.in
+check "traj_prec" 'traj_mode = packed\ntraj_prec = 1e-12\n' ./md t.in
+for kv in step_avg=0 step_dump=0 step_adj_temp=0 limit_rdf=0 step_diff=0 \
+		n_val_diff=0 delta_t=-1 n_out_slot=-1 num_atoms=2; do
+	check "$kv" "${kv/=/ = }\\n" ./md t.in
+done
+check "small box" 'num_atoms = 108\n' ./md t.in
+check "nebr_adapt" 'nebr_adapt = 1\nr_nebr_shell_max = 1\n' ./md t.in
+check "m_tau" 'corr_mode = 2\nm_tau = 0\n' ./md t.in
+check "ckpt n_respa" 'n_respa = 1\n' ./md t.in r.equil.ckpt
+check "ckpt n_corr" 'corr_mode = 1\nn_val_diff = 10\nn_corr = 20\n' ./md t.in c.equil.ckpt
+check "ckpt corr_mode" 'n_val_diff = 10\n' ./md t.in c.equil.ckpt
+for kv in p_tau=8 n_lev_tau=8 m_tau=4; do
+	check "ckpt $kv" "corr_mode = 2\\n${kv/=/ = }\\n" ./md t.in m.equil.ckpt
+done
+check "ckpt trailing" 'n_respa = 2\n' ./md t.in long.ckpt
+for f in neg bits0 short; do
+	check "trj2dump $f" '' ./trj2dump $f.trj
+done
+check "-j 0" '' ./md -j 0 t.in
+check "-j x" '' ./md -j x t.in
+
+cd /
+rm -rf $dir
+[ $fail = 0 ] && echo ok
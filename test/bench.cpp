@@ -0,0 +1,143 @@
+// g++ -O3 -fopenmp -Isrc test/bench.cpp $(ls src/*.cpp | grep -v main.cpp) -o bench
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <vector>
+#include <algorithm>
+
+#include "types.hpp"
+#include "perf.hpp"
+#include "config.hpp"
+#include "arena.hpp"
+#include "md.hpp"
+
+/*
+ * Times the core kernels on FCC lattices and on liquids melted from them,
+ * one record per state, size and kernel, as csv (default) or json:
+ *   ./bench [csv|json] [N ...] [key=value ...]
+ * key=value pairs are input file keys applied to every run, for example
+ * threads=1 or pair_kernel=scalar. Each kernel is called until about
+ * 0.2 s have passed and the median call is reported; the MSD and VACF
+ * buffers are filled first so that all of them are active.
+ */
+static double secsTarget = 0.2;
+
+template <typename F>
+static void timeKernel(F kernel, double &nsCall, int &reps) {
+	std::vector<double> ns;
+	double secs = 0;
+	while (secs < secsTarget || ns.size() < 3) {
+		auto t0 = std::chrono::steady_clock::now();
+		kernel();
+		std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+		ns.push_back(1e9 * dt.count());
+		secs += dt.count();
+	}
+	std::sort(ns.begin(), ns.end());
+	nsCall = ns[ns.size() / 2];
+	reps = ns.size();
+}
+
+int main(int argc, char **argv) {
+	std::string format = "csv";
+	std::vector<int> sizes;
+	std::map<std::string, std::string> extra;
+	for (int k = 1; k < argc; k++) {
+		std::string arg(argv[k]);
+		size_t eq = arg.find('=');
+		if (arg == "csv" || arg == "json") {
+			format = arg;
+		} else if (eq != std::string::npos) {
+			extra[arg.substr(0, eq)] = arg.substr(eq + 1);
+		} else {
+			sizes.push_back(std::stoi(arg));
+		}
+	}
+	if (sizes.empty()) {
+		sizes = {256, 500, 2048, 4000, 13500, 32000, 108000};
+	}
+
+	// FCC near the triple point, and a liquid melted for nMelt steps
+	const char *states[] = {"fcc", "liquid"};
+	const char *temps[] = {"0.5", "1.5"}, *dens[] = {"1.2", "0.8"};
+	int nMelt = 200;
+
+	const char *kernels[] = {"forces", "nebr_list", "rdf", "diffusion", "vacf", "step"};
+	if (format == "csv") {
+		std::cout << "state,kernel,n_atoms,threads,reps,ns_per_call,ns_per_atom,ns_per_pair\n";
+	} else {
+		std::cout << "[";
+	}
+	int nRec = 0;
+	for (int s = 0; s < 2; s++) {
+		for (int num : sizes) {
+			std::map<std::string, std::string> cfg = {{"temperature", temps[s]},
+				{"density", dens[s]}, {"num_atoms", std::to_string(num)},
+				{"mass_ratio", "1"}, {"delta_t", "0.005"},
+				{"step_equil", "1000000000"}, {"step_run", "1000000000"},
+				{"limit_rdf", "1000000000"}, {"step_ckpt", "0"}, {"n_out_slot", "0"}};
+			for (auto &kv : extra) {
+				cfg[kv.first] = kv.second;
+			}
+			// a box too small for the cutoff is refused, with a message
+			Sim *sim = new Sim();
+			if (!sim->initRun(cfg, "", "")) {
+				delete sim;
+				continue;
+			}
+			int nStep = (s == 1) ? nMelt : 1;
+			for (sim->stepCount = 0; sim->stepCount < nStep; sim->stepCount++) {
+				sim->singleStep();
+			}
+			for (int k = 0; k < sim->nValDiff; k++) {
+				sim->evalDiffusion();
+			}
+			for (int k = 0; k < sim->nValAcf; k++) {
+				sim->evalVacf();
+			}
+
+			for (const char *name : kernels) {
+				std::string kernel(name);
+				double nsCall;
+				int reps;
+				if (kernel == "forces") {
+					timeKernel([=] { sim->computeForces(0, 0); }, nsCall, reps);
+				} else if (kernel == "nebr_list") {
+					timeKernel([=] { sim->buildNebrList(); }, nsCall, reps);
+				} else if (kernel == "rdf") {
+					timeKernel([=] { sim->evalRdf(); }, nsCall, reps);
+				} else if (kernel == "diffusion") {
+					timeKernel([=] { sim->evalDiffusion(); }, nsCall, reps);
+				} else if (kernel == "vacf") {
+					timeKernel([=] { sim->evalVacf(); }, nsCall, reps);
+				} else {
+					timeKernel([=] { sim->singleStep(); sim->stepCount++; }, nsCall, reps);
+				}
+				int nMol = sim->nMol, nThreads = sim->nThreads;
+				double nsPair = (kernel == "forces" || kernel == "nebr_list")
+					? nsCall / sim->nebrTabLen : 0;
+				if (format == "csv") {
+					std::cout << states[s] << ',' << kernel << ',' << nMol << ','
+						<< nThreads << ',' << reps << ',' << nsCall << ','
+						<< nsCall / nMol << ',' << nsPair << '\n';
+				} else {
+					std::cout << (nRec++ ? ",\n " : "\n ") << "{\"state\": \"" << states[s]
+						<< "\", \"kernel\": \"" << kernel << "\", \"n_atoms\": " << nMol
+						<< ", \"threads\": " << nThreads << ", \"reps\": " << reps
+						<< ", \"ns_per_call\": " << nsCall << ", \"ns_per_atom\": "
+						<< nsCall / nMol << ", \"ns_per_pair\": " << nsPair << "}";
+				}
+				std::cout.flush();
+			}
+			sim->endRun(0);
+			delete sim;
+		}
+	}
+	if (format == "json") {
+		std::cout << "\n]\n";
+	}
+	return 0;
+}
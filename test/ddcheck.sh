@@ -0,0 +1,46 @@
+#!/bin/bash
+# Runs one 4000 atom liquid on 1, 2, 4 and 8 ranks and checks that the
+# energies, pressure and MSD agree with the single rank run; the forces
+# are summed in another order on each, so they drift apart slowly. From
+# the top directory, with MPIRUN set to what starts a job here:
+#   MPIRUN="mpirun --oversubscribe" bash test/ddcheck.sh
+set -e
+MPIRUN=${MPIRUN:-mpirun}
+dir=$(mktemp -d)
+mpicxx -O3 -DUSE_MPI src/*.cpp -o $dir/md
+
+for n in 1 2 4 8; do
+	mkdir $dir/$n
+	cat > $dir/$n/dd.in <<EOF
+temperature = 1.5
+density = 0.8
+num_atoms = 4000
+mass_ratio = 1
+step_equil = 100
+step_run = 400
+step_avg = 10
+step_diff = 5
+n_val_diff = 20
+n_buff_diff = 4
+step_ckpt = 0
+EOF
+	(cd $dir/$n && $MPIRUN -np $n ../md dd.in)
+done
+
+fail=0
+for n in 2 4 8; do
+	for f in out msd; do
+		# numeric rows only; column 3 of .out is the momentum, round-off
+		awk -v n=$n -v f=$f 'FNR == 1 { file++ } !/^[0-9]/ { next }
+			file == 1 { ref[FNR] = $0; next }
+			{ split(ref[FNR], r); for (k = 2; k <= NF; k++) {
+				if (f == "out" && k == 3) continue
+				d = $k - r[k]; if (d < 0) d = -d
+				s = (r[k] < 0) ? -r[k] : r[k]
+				if (d > 1e-4 * (s > 1 ? s : 1)) { print n " ranks: " f " line " FNR " differs"; bad = 1; exit } } }
+			END { exit bad }' $dir/1/dd.$f $dir/$n/dd.$f || fail=1
+	done
+	grep Ranks $dir/$n/dd.out
+done
+rm -rf $dir
+[ $fail = 0 ] && echo ok
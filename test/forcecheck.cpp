@@ -0,0 +1,108 @@
+// g++ -O2 -Isrc test/forcecheck.cpp src/pair_force.cpp -o forcecheck
+#include <iostream>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+#include "pair_force.hpp"
+
+/*
+ * compares the SIMD pair kernels this CPU supports against the scalar one
+ * on a perturbed two-species FCC lattice; exits non-zero on a mismatch
+ */
+int main() {
+	int nUcell = 6, nMol = 4 * nUcell * nUcell * nUcell, nType = 2;
+	double density = 1.2, rCut = 3, rNebr = 3.4;
+	double gap = std::pow(4.0 / density, 1/3.0), len = gap * nUcell;
+	vecR region = {len, len, len};
+
+	std::vector<double> rx(nMol), ry(nMol), rz(nMol);
+	std::vector<int> type(nMol);
+	std::default_random_engine rand_gen;
+	std::uniform_real_distribution<double> jitter(-0.1, 0.1);
+	double basis[4][3] = {{0.25, 0.25, 0.25}, {0.75, 0.75, 0.25},
+		{0.25, 0.75, 0.75}, {0.75, 0.25, 0.75}};
+	int n = 0;
+	for (int nz = 0; nz < nUcell; nz++) {
+		for (int ny = 0; ny < nUcell; ny++) {
+			for (int nx = 0; nx < nUcell; nx++) {
+				for (int j = 0; j < 4; j++) {
+					rx[n] = (nx + basis[j][0]) * gap - 0.5 * len + jitter(rand_gen);
+					ry[n] = (ny + basis[j][1]) * gap - 0.5 * len + jitter(rand_gen);
+					rz[n] = (nz + basis[j][2]) * gap - 0.5 * len + jitter(rand_gen);
+					type[n] = (n % 5 == 0) ? 2 : 1;
+					n++;
+				}
+			}
+		}
+	}
+
+	double eps[] = {1.0, 1.5, 1.5, 0.5};
+	double sig[] = {1.0, 0.8, 0.8, 0.88};
+	LJpair ljTab[4];
+	double rri6 = 1.0 / std::pow(rCut, 6);
+	for (int k = 0; k < nType*nType; k++) {
+		double sig6 = std::pow(sig[k], 6);
+		ljTab[k].fc12 = 48.0 * eps[k] * sig6 * sig6;
+		ljTab[k].fc6 = 24.0 * eps[k] * sig6;
+		ljTab[k].rrCut = rCut * rCut;
+		ljTab[k].uShift = 4.0 * eps[k] * sig6 * rri6 * (sig6 * rri6 - 1.0);
+	}
+
+	// all-pairs half list in CSR form
+	std::vector<int> nebrStart(nMol + 1, 0), nebrTab;
+	for (int i = 0; i < nMol; i++) {
+		for (int j = i + 1; j < nMol; j++) {
+			double d[3] = {rx[i] - rx[j], ry[i] - ry[j], rz[i] - rz[j]};
+			double rr = 0;
+			for (int c = 0; c < 3; c++) {
+				d[c] -= len * std::round(d[c] / len);
+				rr += d[c] * d[c];
+			}
+			if (rr < rNebr * rNebr) {
+				nebrTab.push_back(j);
+			}
+		}
+		nebrStart[i+1] = nebrTab.size();
+	}
+
+	PairArgs args = {rx.data(), ry.data(), rz.data(), type.data(),
+		nebrStart.data(), nebrTab.data(), ljTab, nType, region};
+
+	std::vector<double> fRef(3 * nMol, 0.0);
+	double uRef = 0, virRef = 0;
+	pairForceScalar(args, 0, nMol, &fRef[0], &fRef[nMol], &fRef[2*nMol], uRef, virRef);
+	double fMax = 0;
+	for (double f : fRef) {
+		fMax = std::max(fMax, std::fabs(f));
+	}
+	std::cout << "scalar: u = " << uRef / 12.0 / nMol
+		<< ", vir = " << virRef / nMol << '\n';
+
+	int fail = 0;
+	for (std::string name : {"avx2", "avx512"}) {
+		PairKernel kernel = selectPairKernel(name);
+		if (!kernel) {
+			std::cout << name << ": not supported, skipped\n";
+			continue;
+		}
+		std::vector<double> f(3 * nMol, 0.0);
+		double u = 0, vir = 0;
+		kernel(args, 0, nMol, &f[0], &f[nMol], &f[2*nMol], u, vir);
+
+		double fErr = 0;
+		for (int k = 0; k < 3 * nMol; k++) {
+			fErr = std::max(fErr, std::fabs(f[k] - fRef[k]));
+		}
+		double uErr = std::fabs(u - uRef) / std::fabs(uRef);
+		double virErr = std::fabs(vir - virRef) / std::fabs(virRef);
+		bool ok = uErr < 1e-12 && virErr < 1e-12 && fErr < 1e-10 * fMax;
+		std::cout << name << ": energy " << uErr << ", virial " << virErr
+			<< ", force " << fErr / fMax << (ok ? "  ok\n" : "  FAILED\n");
+		fail += !ok;
+	}
+
+	return fail;
+}
@@ -0,0 +1,57 @@
+// g++ -O2 -Isrc tools/trj2dump.cpp src/traj.cpp -o trj2dump
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+#include "traj.hpp"
+
+/*
+ * converts a binary .trj trajectory to the text dump format posDump()
+ * writes with TRAJ_TEXT: trj2dump in.trj > out.dump
+ */
+int main(int argc, char **argv) {
+	if (argc != 2) {
+		std::cerr << "usage: " << argv[0] << " file.trj\n";
+		return 1;
+	}
+	std::ifstream trajFile(argv[1], std::ifstream::binary);
+	if (!trajFile) {
+		std::cerr << "cannot open " << argv[1] << '\n';
+		return 1;
+	}
+
+	TrajInfo info = {0, 0, 0, nullptr};
+	std::vector<double> r(1);
+	double time;
+	vecR region;
+	int status, nFrame = 0;
+	while ((status = trajReadBlock(trajFile, info, time, region,
+			&r[0], &r[info.nMol], &r[2*info.nMol])) > 0) {
+		if (status == 1) {
+			r.resize(3 * info.nMol + 1);
+			continue;
+		}
+		int nMol = info.nMol;
+		std::cout << "ITEM: TIMESTEP\n" << time << '\n'
+			<< "ITEM: NUMBER OF ATOMS\n" << nMol << '\n'
+			<< "ITEM: BOX BOUNDS pp pp pp\n"
+			<< -0.5*region.x << ' ' << 0.5*region.x << '\n'
+			<< -0.5*region.y << ' ' << 0.5*region.y << '\n'
+			<< -0.5*region.z << ' ' << 0.5*region.z << '\n'
+			<< "ITEM: ATOMS id type x y z\n";
+		for (int n = 0; n < nMol; n++) {
+			std::cout << n+1 << ' ' << info.type[n] << ' '
+				<< r[n] << ' ' << r[nMol+n] << ' ' << r[2*nMol+n] << '\n';
+		}
+		nFrame++;
+	}
+	delete[] info.type;
+
+	if (status < 0) {
+		std::cerr << argv[1] << ": bad block after frame " << nFrame << '\n';
+		return 1;
+	}
+	return 0;
+}